@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+#include "ctrl/scbi.h"
+#include "ctrl/frame_archive.h"
+
+/* throughput of scbi_parse/scbi_pop_param for synthetic and recorded frame mixes,
+ * at several registration sizes and log levels. Runs on the build host, see Makefile.
+ */
+
+#define BENCH_FRAMES   200000
+#define BENCH_ROUNDS   5
+#define BENCH_MAX_REC  1000000
+
+enum bench_mix
+{
+  BM_SENSOR,       // datalogger sensor responses, values drift slowly
+  BM_OVERVIEW,     // overview bursts: all types/modes at once, then quiet sensor traffic
+  BM_HCC,          // heating circuit chatter - decoded, never a parameter
+  BM_UNSUPPORTED,  // programs sorella doesn't know
+  BM_ERROR,        // error frames
+  BM_MIXED,        // a bit of everything, roughly like a live bus
+  BM_COUNT
+};
+
+static const char * mix_name[BM_COUNT] = { "sensor", "overview", "hcc", "unsupported", "error", "mixed" };
+
+static const size_t reg_sizes[] = { 16, 256, 2048 };
+
+static const struct { enum scbi_log_level ll; const char * name; } log_levels[] = {
+  { SCBI_LL_ERROR, "error" },
+  { SCBI_LL_INFO,  "info"  },
+  { SCBI_LL_DEBUG, "debug" },
+};
+
+static size_t alloc_cnt;
+static size_t alloc_bytes;
+
+static void * bench_alloc(size_t size)
+{
+  alloc_cnt++;
+  alloc_bytes += size;
+  return malloc(size);
+}
+
+/* formats like a real sink would, but doesn't print */
+static void bench_log(enum scbi_log_level ll, const char * format, ...)
+{
+  static char line[512];
+  va_list ap;
+
+  (void) ll;
+  va_start(ap, format);
+  vsnprintf(line, sizeof(line), format, ap);
+  va_end(ap);
+}
+
+static inline uint64_t bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t cnt;
+  __asm__ volatile ("mrs %0, cntvct_el0" : "=r" (cnt));  // generic timer, not core cycles
+  return cnt;
+#else
+  return 0;
+#endif
+}
+
+static uint64_t bench_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t rnd_state = 0x12345678;
+
+static uint32_t rnd(void)      /* xorshift, reproducible mixes */
+{
+  rnd_state ^= rnd_state << 13;
+  rnd_state ^= rnd_state >> 17;
+  rnd_state ^= rnd_state << 5;
+  return rnd_state;
+}
+
+static void make_frame(struct scbi_frame * frame, enum scbi_prog_type prog, uint8_t func, enum scbi_msg_type msg, const uint8_t * data, uint8_t len)
+{
+  memset(frame, 0, sizeof(*frame));
+  frame->msg.can_id = CAN_EFF_FLAG | ((uint32_t) msg << 27) | ((uint32_t) CAN_PROTO_FORMAT_0 << 24) | ((uint32_t) func << 16) | (0x9F << 8) | prog;
+  frame->msg.len    = len;
+  memcpy(frame->msg.data, data, len);
+}
+
+static void gen_sensor(struct scbi_frame * frame)
+{
+  int32_t value = 200 + rnd() % 8;
+  uint8_t data[6] = { rnd() % 32, value, value >> 8, value >> 16, value >> 24, DST_TEMPERATURE };
+
+  make_frame(frame, PRG_DATALOGGER_MONITOR, DLF_SENSOR, CAN_MSG_RESPONSE, data, sizeof(data));
+}
+
+static void gen_relay(struct scbi_frame * frame)
+{
+  uint8_t data[5] = { rnd() % 8, DRM_RELAYMODE_SWITCHED, rnd() % 2 ? 100 : 0, DRE_UNSELECTED, 0 };
+
+  make_frame(frame, PRG_DATALOGGER_MONITOR, DLF_RELAY, CAN_MSG_RESPONSE, data, sizeof(data));
+}
+
+static void gen_overview(struct scbi_frame * frame, uint32_t i)
+{
+  uint8_t data[8] = { ((1 + i % (DOT_COUNT - 1)) << 5), (i / (DOT_COUNT - 1)) % DOM_COUNT, rnd() % 50, 0, rnd(), rnd(), 0, 0 };
+
+  make_frame(frame, PRG_DATALOGGER_MONITOR, DLG_OVERVIEW, CAN_MSG_RESPONSE, data, sizeof(data));
+}
+
+static void gen_hcc(struct scbi_frame * frame)
+{
+  uint8_t func = rnd() % 5;
+  uint8_t data[6] = { rnd() % 4, rnd(), rnd(), rnd(), rnd(), rnd() };
+
+  make_frame(frame, PRG_HCC, func, CAN_MSG_RESPONSE, data, sizeof(data));
+}
+
+static void gen_unsupported(struct scbi_frame * frame)
+{
+  static const uint8_t prog[] = { PRG_REMOTESENSOR, PRG_AVAILABLERESOURCES, PRG_PARAMETERSYNCCONFIG, PRG_ROOMSYNC, PRG_MSGLOG, PRG_CBCS };
+  uint8_t data[8] = { rnd(), rnd(), rnd(), rnd(), rnd(), rnd(), rnd(), rnd() };
+
+  make_frame(frame, prog[rnd() % sizeof(prog)], rnd() % 8, CAN_MSG_RESPONSE, data, sizeof(data));
+}
+
+static void gen_error(struct scbi_frame * frame)
+{
+  uint8_t data[8] = { 0 };
+
+  make_frame(frame, PRG_DATALOGGER_MONITOR, DLF_SENSOR, CAN_MSG_ERROR, data, sizeof(data));
+  if (rnd() % 2)
+    frame->msg.can_id |= CAN_ERR_FLAG;
+}
+
+static void gen_mix(struct scbi_frame * frame, size_t cnt, enum bench_mix mix)
+{
+  rnd_state = 0x12345678;
+  for (size_t i = 0; i < cnt; i++)
+  {
+    uint32_t r = rnd() % 100;
+
+    switch (mix)
+    {
+      case BM_SENSOR:      gen_sensor(&frame[i]);                                         break;
+      case BM_OVERVIEW:    if ((i / 64) % 4 == 0) gen_overview(&frame[i], i); else gen_sensor(&frame[i]); break;
+      case BM_HCC:         gen_hcc(&frame[i]);                                            break;
+      case BM_UNSUPPORTED: gen_unsupported(&frame[i]);                                    break;
+      case BM_ERROR:       gen_error(&frame[i]);                                          break;
+      case BM_MIXED:
+        if (r < 50)      gen_sensor(&frame[i]);
+        else if (r < 70) gen_relay(&frame[i]);
+        else if (r < 80) gen_overview(&frame[i], i);
+        else if (r < 90) gen_hcc(&frame[i]);
+        else if (r < 98) gen_unsupported(&frame[i]);
+        else             gen_error(&frame[i]);
+        break;
+      case BM_COUNT:
+        break;
+    }
+    frame[i].recvd = i * 2;   // ~500 frames/s
+  }
+}
+
+/* registrations of the live configuration come first, the rest fill the table with sensors that stay silent */
+static void register_params(struct scbi_handle * hnd, size_t cnt)
+{
+  static char names[UINT16_MAX][12];
+  size_t n = 0;
+
+  for (size_t id = 0; id < 32 && n < cnt; id++, n++)
+  {
+    snprintf(names[n], sizeof(names[n]), "s%zu", id);
+    scbi_register_sensor(hnd, SCBI_DEVICE_ANY, id, DST_TEMPERATURE, names[n]);
+  }
+  for (size_t id = 0; id < 8 && n < cnt; id++, n++)
+  {
+    snprintf(names[n], sizeof(names[n]), "r%zu", id);
+    scbi_register_relay(hnd, SCBI_DEVICE_ANY, id, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, names[n]);
+  }
+  for (size_t type = 1; type < DOT_COUNT && n < cnt; type++)
+  {
+    for (size_t mode = 0; mode < DOM_COUNT && n < cnt; mode++, n++)
+    {
+      snprintf(names[n], sizeof(names[n]), "o%zu_%zu", type, mode);
+      scbi_register_overview(hnd, SCBI_DEVICE_ANY, type, mode, names[n]);
+    }
+  }
+  for (size_t i = 0; n < cnt && i < DST_COUNT * (UINT8_MAX + 1); i++)
+  {
+    size_t type = i / (UINT8_MAX + 1), id = i % (UINT8_MAX + 1);
+
+    if (type == DST_TEMPERATURE && id < 32)
+      continue;
+    snprintf(names[n], sizeof(names[n]), "x%zu", i);
+    if (scbi_register_sensor(hnd, SCBI_DEVICE_ANY, id, type, names[n]) == 0)
+      n++;
+  }
+}
+
+struct bench_result
+{
+  double   frames_s;
+  double   ns_frame;
+  double   cycles_frame;
+  uint64_t params;
+  size_t   allocs;
+  size_t   alloc_bytes;
+};
+
+static void bench_run(struct bench_result * res, struct scbi_frame * frame, size_t cnt, size_t regs, enum scbi_log_level ll, int rounds)
+{
+  struct scbi_handle * hnd;
+  struct scbi_frame *  work = malloc(cnt * sizeof(*work));
+  uint64_t best_ns = UINT64_MAX, best_cyc = 0;
+
+  memset(res, 0, sizeof(*res));
+  alloc_cnt = alloc_bytes = 0;
+  hnd = scbi_init_ex(bench_alloc, bench_log, ll, 300, regs);
+  if (hnd == NULL || work == NULL)
+  {
+    fprintf(stderr, "Could not set up %zu parameters.\n", regs);
+    exit(EXIT_FAILURE);
+  }
+  register_params(hnd, regs);
+  res->allocs      = alloc_cnt;
+  res->alloc_bytes = alloc_bytes;
+
+  for (int r = 0; r < rounds; r++)
+  {
+    uint64_t t0, t1, c0, c1, params = 0;
+
+    memcpy(work, frame, cnt * sizeof(*work));
+    t0 = bench_ns();
+    c0 = bench_cycles();
+    for (size_t i = 0; i < cnt; i++)
+    {
+      scbi_parse(hnd, &work[i]);
+      while (scbi_pop_param(hnd) != NULL)
+        params++;
+    }
+    c1 = bench_cycles();
+    t1 = bench_ns();
+    if (t1 - t0 < best_ns)
+    {
+      best_ns  = t1 - t0;
+      best_cyc = c1 - c0;
+    }
+    res->params = params;
+  }
+  /* the library only allocates in scbi_init_ex, anything beyond shows up here */
+  res->allocs      = alloc_cnt;
+  res->alloc_bytes = alloc_bytes;
+  res->ns_frame     = (double) best_ns / cnt;
+  res->frames_s     = best_ns ? cnt * 1e9 / best_ns : 0;
+  res->cycles_frame = (double) best_cyc / cnt;
+  free(hnd);
+  free(work);
+}
+
+static void bench_print_head(void)
+{
+  printf("%-12s %6s %-6s %12s %9s %12s %9s %7s %9s\n",
+         "mix", "regs", "log", "frames/s", "ns/frame", "cycles/frame", "params", "allocs", "bytes");
+}
+
+static void bench_mix(const char * name, struct scbi_frame * frame, size_t cnt, int rounds)
+{
+  for (size_t r = 0; r < sizeof(reg_sizes) / sizeof(reg_sizes[0]); r++)
+  {
+    for (size_t l = 0; l < sizeof(log_levels) / sizeof(log_levels[0]); l++)
+    {
+      struct bench_result res;
+
+      bench_run(&res, frame, cnt, reg_sizes[r], log_levels[l].ll, rounds);
+      printf("%-12.12s %6zu %-6s %12.0f %9.1f %12.1f %9llu %7zu %9zu\n", name, reg_sizes[r], log_levels[l].name,
+             res.frames_s, res.ns_frame, res.cycles_frame, (unsigned long long) res.params, res.allocs, res.alloc_bytes);
+      fflush(stdout);
+    }
+  }
+}
+
+/* recorded frames: a frame archive or a candump -L log, times are taken from the recording */
+static size_t load_recording(const char * fname, struct scbi_frame * frame, size_t max)
+{
+  size_t cnt = 0;
+  size_t len = strlen(fname);
+
+  if (len > strlen(FA_FILE_EXT) && strcmp(fname + len - strlen(FA_FILE_EXT), FA_FILE_EXT) == 0)
+  {
+    struct fa_reader * rd = fa_reader_open(fname);
+    uint64_t ms;
+
+    if (rd == NULL)
+      return 0;
+    while (cnt < max && fa_reader_next(rd, &frame[cnt], &ms) == 0)
+      cnt++;
+    fa_reader_close(rd);
+  }
+  else
+  {
+    FILE *   fp = fopen(fname, "r");
+    char     line[256], data[32];
+    unsigned sec, usec, id;
+
+    if (fp == NULL)
+      return 0;
+    while (cnt < max && fgets(line, sizeof(line), fp))
+    {
+      if (sscanf(line, "(%u.%u) %*s %x#%31[0-9A-Fa-f]", &sec, &usec, &id, data) != 4)
+        continue;
+      memset(&frame[cnt], 0, sizeof(frame[cnt]));
+      frame[cnt].msg.can_id = id | CAN_EFF_FLAG;
+      for (size_t i = 0; data[2 * i] && data[2 * i + 1] && i < CAN_MAX_DLEN; i++)
+      {
+        unsigned byte;
+        sscanf(&data[2 * i], "%2x", &byte);
+        frame[cnt].msg.data[frame[cnt].msg.len++] = byte;
+      }
+      frame[cnt].recvd = sec * 1000 + usec / 1000;
+      cnt++;
+    }
+    fclose(fp);
+  }
+  return cnt;
+}
+
+int main(int argc, char * argv[])
+{
+  struct scbi_frame * frame;
+  size_t cnt = BENCH_FRAMES;
+  int    rounds = BENCH_ROUNDS;
+  int    opt;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': cnt = strtoul(optarg, NULL, 10); break;
+      case 'r': rounds = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n <frames per mix>] [-r <rounds>] [<candump -L log> | <archive" FA_FILE_EXT ">]...\n"
+                        "  the fastest of <rounds> runs is reported.\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (cnt == 0 || rounds <= 0)
+    exit(EXIT_FAILURE);
+
+  frame = malloc((cnt > BENCH_MAX_REC ? cnt : BENCH_MAX_REC) * sizeof(*frame));
+  if (frame == NULL)
+    exit(EXIT_FAILURE);
+
+  bench_print_head();
+  for (int mix = 0; mix < BM_COUNT; mix++)
+  {
+    gen_mix(frame, cnt, mix);
+    bench_mix(mix_name[mix], frame, cnt, rounds);
+  }
+  for (int i = optind; i < argc; i++)
+  {
+    size_t rec = load_recording(argv[i], frame, BENCH_MAX_REC);
+    const char * base = strrchr(argv[i], '/');
+
+    if (rec == 0)
+    {
+      fprintf(stderr, "No frames in %s.\n", argv[i]);
+      continue;
+    }
+    bench_mix(base ? base + 1 : argv[i], frame, rec, rounds);
+  }
+  free(frame);
+  return EXIT_SUCCESS;
+}
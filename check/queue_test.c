@@ -0,0 +1,91 @@
+/*
+ * queue_test.c
+ *
+ * Checks the order in which scbi_pop_param serves the priority classes:
+ * a higher class always goes first, but a class out of tokens lets the
+ * lower classes pass until it is refilled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ctrl/scbi.h"
+
+static int failed;
+
+static void log_push(enum scbi_log_level ll, const char * format, ...)
+{
+  (void) ll;
+  (void) format;
+}
+
+/* datalogger sensor frame: id, S32 value, type */
+static void send_sensor(struct scbi_handle * hnd, uint8_t id, int32_t value, scbi_time recvd)
+{
+  struct scbi_frame frame;
+
+  memset(&frame, 0, sizeof(frame));
+  frame.msg.can_id  = CAN_EFF_FLAG | (CAN_MSG_RESPONSE << 27) | (DLF_SENSOR << 16) | PRG_DATALOGGER_MONITOR;
+  frame.msg.can_dlc = 6;
+  frame.msg.data[0] = id;
+  memcpy(&frame.msg.data[1], &value, sizeof(value));
+  frame.msg.data[5] = DST_UNKNOWN;
+  frame.recvd = recvd;
+  scbi_parse(hnd, &frame);
+}
+
+static void expect_pop(struct scbi_handle * hnd, const char * name, const char * step)
+{
+  struct scbi_param * param = scbi_pop_param(hnd);
+  const char * got = param ? param->name : "(none)";
+
+  if (strcmp(got, name ? name : "(none)") != 0)
+  {
+    fprintf(stderr, "FAIL %s: expected %s, got %s\n", step, name ? name : "(none)", got);
+    failed++;
+  }
+}
+
+int main(void)
+{
+  struct scbi_handle * hnd = scbi_init(malloc, log_push, SCBI_LL_ERROR, 600);
+
+  if (hnd == NULL)
+    return 1;
+  scbi_register_sensor(hnd, SCBI_DEVICE_ANY, 0, DST_UNDEFINED, "collector");
+  scbi_register_sensor(hnd, SCBI_DEVICE_ANY, 1, DST_UNDEFINED, "storage");
+  scbi_set_priority(hnd, SCBI_DEVICE_ANY, "storage", SCBI_PRIO_LOW);
+
+  /* unlimited: the higher class is served first, whatever the arrival order */
+  send_sensor(hnd, 1, 100, 1000);
+  send_sensor(hnd, 0, 100, 1000);
+  expect_pop(hnd, "collector", "unlimited, normal first");
+  expect_pop(hnd, "storage",   "unlimited, low second");
+  expect_pop(hnd, NULL,        "unlimited, queues empty");
+
+  /* one value per second for normal: its burst token is used up by the first change */
+  scbi_set_rate_limit(hnd, SCBI_PRIO_NORMAL, 1, 1);
+  send_sensor(hnd, 0, 101, 2000);
+  send_sensor(hnd, 1, 101, 2000);
+  expect_pop(hnd, "collector", "limited, normal with token");
+  expect_pop(hnd, "storage",   "limited, low after normal");
+
+  /* normal is out of tokens and keeps its value queued, low passes meanwhile */
+  send_sensor(hnd, 0, 102, 2100);
+  send_sensor(hnd, 1, 102, 2100);
+  expect_pop(hnd, "storage",   "throttled normal, low passes");
+  expect_pop(hnd, NULL,        "throttled normal held back");
+
+  /* refilled: normal goes first again, with the latest value only */
+  send_sensor(hnd, 0, 103, 3000);
+  send_sensor(hnd, 1, 103, 3000);
+  expect_pop(hnd, "collector", "refilled, normal first");
+  expect_pop(hnd, "storage",   "refilled, low second");
+  expect_pop(hnd, NULL,        "refilled, queues empty");
+
+  if (failed)
+    return 1;
+  printf("queue-test: ok\n");
+  return 0;
+}
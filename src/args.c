@@ -6,6 +6,18 @@
 #include "args.h"
 #include "version.h"
 
+static const char * prio_name[SCBI_PRIO_CNT] = { "high", "normal", "low" };
+
+/* priority class by name, SCBI_PRIO_CNT if unknown */
+static enum scbi_priority get_prio(const char * name)
+{
+  int prio;
+
+  for (prio = 0; prio < SCBI_PRIO_CNT; prio++)
+    if (strcmp(name, prio_name[prio]) == 0)
+      break;
+  return (enum scbi_priority) prio;
+}
 
 int parseArgs(int argc, char * argv[], struct cansorella_config * config)
 {
@@ -21,15 +33,17 @@ int parseArgs(int argc, char * argv[], struct cansorella_config * config)
 
   config->log_facility = DEFAULT_LOG_FACILITY;
   config->log_level    = DEFAULT_LOG_LEVEL;
-  config->can_device   = DEFAULT_CAN_DEVICE;
 
   config->mqtt.remote_address = DEFAULT_MQTT_REMOTE;
   config->mqtt.remote_port    = DEFAULT_MQTT_PORT;
   config->mqtt.client_id      = DEFAULT_MQTT_CLIENT_ID;
   config->mqtt.topic          = DEFAULT_MQTT_TOPIC;
   config->mqtt.qos            = DEFAULT_MQTT_QOS;
+  config->publish.spool_size  = DEFAULT_SPOOL_SIZE_KB * 1024;
+  config->publish.archive_size = DEFAULT_ARCHIVE_SIZE_MB * 1024 * 1024;
+  config->publish.ts_size      = (size_t) DEFAULT_TS_SIZE_MB * 1024 * 1024;
 
-  while ((opt = getopt(argc, argv, "hf:Vv:d:m:r:p:i:t:q:")) != -1)
+  while ((opt = getopt(argc, argv, "hf:Vv:d:D:b:g:P:l:H:L:M:T:m:r:p:i:t:q:w:so:z:a:A:")) != -1)
   {
     switch (opt)
     {
@@ -40,7 +54,149 @@ int parseArgs(int argc, char * argv[], struct cansorella_config * config)
           fprintf(stderr, "Error: empty device name.\n");
           goto ON_ERROR;
         }
-        config->can_device = optarg;
+        if (config->can_cnt >= CANSORELLA_MAX_CAN)
+        {
+          fprintf(stderr, "Error: too many CAN devices (max. %d).\n", CANSORELLA_MAX_CAN);
+          goto ON_ERROR;
+        }
+        config->can_device[config->can_cnt++] = optarg;
+        break;
+      }
+      case 'D':
+      {
+        long client = strtol(optarg, &end, 0);
+
+        if (end == optarg || *end != ':' || end[1] == '\0' || client < 0 || client > UINT8_MAX)
+        {
+          fprintf(stderr, "Error: invalid device (%s), expected <client id>:<name>.\n", optarg);
+          goto ON_ERROR;
+        }
+        if (config->dev_cnt >= SCBI_MAX_DEVICES)
+        {
+          fprintf(stderr, "Error: too many devices (max. %d).\n", SCBI_MAX_DEVICES);
+          goto ON_ERROR;
+        }
+        config->dev[config->dev_cnt].client = client;
+        config->dev[config->dev_cnt].name   = end + 1;
+        config->dev_cnt++;
+        break;
+      }
+      case 'b':
+      {
+        struct cansorella_band * band = &config->band[config->band_cnt];
+        char * sep = strchr(optarg, ':');
+        unsigned long val[3] = { 0, 0, 0 };
+        int cnt = 0;
+
+        if (config->band_cnt >= CANSORELLA_MAX_BANDS)
+        {
+          fprintf(stderr, "Error: too many deadbands (max. %d).\n", CANSORELLA_MAX_BANDS);
+          goto ON_ERROR;
+        }
+        if (sep == NULL || sep == optarg)
+        {
+          fprintf(stderr, "Error: invalid deadband (%s), expected <name>:<absolute>[:<relative>[:<hysteresis>]].\n", optarg);
+          goto ON_ERROR;
+        }
+        for (end = sep; *end == ':' && cnt < 3; cnt++)
+        {
+          char * num = end + 1;
+
+          val[cnt] = strtoul(num, &end, 0);
+          if (end == num || val[cnt] > UINT32_MAX)
+          {
+            end = num - 1;   /* points at a ':', rejected below */
+            break;
+          }
+        }
+        if (*end != '\0' || cnt == 0)
+        {
+          fprintf(stderr, "Error: invalid deadband (%s).\n", optarg);
+          goto ON_ERROR;
+        }
+        *sep = '\0';
+        band->name            = optarg;
+        band->band.absolute   = val[0];
+        band->band.relative   = val[1];
+        band->band.hysteresis = val[2];
+        config->band_cnt++;
+        break;
+      }
+      case 'g':
+      {
+        char * sep = strchr(optarg, ':');
+        unsigned long window;
+
+        if (config->agg_cnt >= CANSORELLA_MAX_AGGREGATES)
+        {
+          fprintf(stderr, "Error: too many aggregated parameters (max. %d).\n", CANSORELLA_MAX_AGGREGATES);
+          goto ON_ERROR;
+        }
+        if (sep == NULL || sep == optarg || (window = strtoul(sep + 1, &end, 10)) == 0 || end == sep + 1 || *end != '\0' || window > UINT32_MAX / 1000)
+        {
+          fprintf(stderr, "Error: invalid aggregation (%s), expected <name>:<window s>.\n", optarg);
+          goto ON_ERROR;
+        }
+        *sep = '\0';
+        config->agg[config->agg_cnt].name     = optarg;
+        config->agg[config->agg_cnt].window_s = window;
+        config->agg_cnt++;
+        break;
+      }
+      case 'P':
+      {
+        char * sep = strchr(optarg, ':');
+
+        if (config->prio_cnt >= CANSORELLA_MAX_PRIOS)
+        {
+          fprintf(stderr, "Error: too many priorities (max. %d).\n", CANSORELLA_MAX_PRIOS);
+          goto ON_ERROR;
+        }
+        if (sep == NULL || sep == optarg || get_prio(sep + 1) == SCBI_PRIO_CNT)
+        {
+          fprintf(stderr, "Error: invalid priority (%s), expected <name>:<high|normal|low>.\n", optarg);
+          goto ON_ERROR;
+        }
+        *sep = '\0';
+        config->prio[config->prio_cnt].name = optarg;
+        config->prio[config->prio_cnt].prio = get_prio(sep + 1);
+        config->prio_cnt++;
+        break;
+      }
+      case 'H':
+      {
+        unsigned long circuit = strtoul(optarg, &end, 0);
+
+        if (config->hcc_cnt >= CANSORELLA_MAX_HCC)
+        {
+          fprintf(stderr, "Error: too many heating circuits (max. %d).\n", CANSORELLA_MAX_HCC);
+          goto ON_ERROR;
+        }
+        if (end == optarg || *end != '\0' || circuit > UINT8_MAX)
+        {
+          fprintf(stderr, "Error: invalid heating circuit (%s).\n", optarg);
+          goto ON_ERROR;
+        }
+        config->hcc[config->hcc_cnt++] = circuit;
+        break;
+      }
+      case 'l':
+      {
+        char * sep = strchr(optarg, ':');
+        enum scbi_priority prio;
+        unsigned long rate, burst = 0;
+
+        if (sep)
+          *sep = '\0';
+        prio = get_prio(optarg);
+        if (sep == NULL || prio == SCBI_PRIO_CNT || (rate = strtoul(sep + 1, &end, 10)) == 0 || end == sep + 1 || rate > UINT32_MAX / 1000
+            || (*end == ':' && ((burst = strtoul(end + 1, &end, 10)) == 0 || burst > UINT32_MAX / 1000)) || *end != '\0')
+        {
+          fprintf(stderr, "Error: invalid rate limit, expected <high|normal|low>:<rate/s>[:<burst>].\n");
+          goto ON_ERROR;
+        }
+        config->limit[prio].rate  = rate;
+        config->limit[prio].burst = burst ? burst : rate;
         break;
       }
       case 'v':
@@ -113,6 +269,103 @@ int parseArgs(int argc, char * argv[], struct cansorella_config * config)
         break;
       }
 
+      case 'w':
+      {
+        long window = strtol(optarg, &end, 0);
+
+        if (end == optarg || *end != '\0' || window < 0 || window > MAX_PUBLISH_WINDOW_MS) {
+          fprintf(stderr, "Error: invalid publish window.\n");
+          goto ON_ERROR;
+        }
+        config->publish.window_ms = window;
+        break;
+      }
+      case 's':
+      {
+        config->publish.single = 1;
+        break;
+      }
+      case 'o':
+      {
+        config->publish.spool_path = optarg;
+        if (*optarg == '\0') {
+          fprintf(stderr, "Error: empty spool file name.\n");
+          goto ON_ERROR;
+        }
+        break;
+      }
+      case 'z':
+      {
+        long size = strtol(optarg, &end, 0);
+
+        if (end == optarg || *end != '\0' || size < 1 || size > 1024 * 1024) {
+          fprintf(stderr, "Error: invalid spool size.\n");
+          goto ON_ERROR;
+        }
+        config->publish.spool_size = size * 1024;
+        break;
+      }
+      case 'a':
+      {
+        config->publish.archive_prefix = optarg;
+        if (*optarg == '\0') {
+          fprintf(stderr, "Error: empty archive prefix.\n");
+          goto ON_ERROR;
+        }
+        break;
+      }
+      case 'L':
+      {
+        if (*optarg != '/' || optarg[1] == '\0' || strchr(optarg + 1, '/')) {
+          fprintf(stderr, "Error: invalid live table name, expected /<name>.\n");
+          goto ON_ERROR;
+        }
+        config->publish.live_name = optarg;
+        break;
+      }
+      case 'M':
+      {
+        if (*optarg == '\0') {
+          fprintf(stderr, "Error: empty metrics address.\n");
+          goto ON_ERROR;
+        }
+        config->publish.metrics_addr = optarg;
+        break;
+      }
+      case 'T':
+      {
+        char * sep = strrchr(optarg, ':');
+
+        if (sep)
+        {
+          unsigned long size = strtoul(sep + 1, &end, 10);
+
+          if (end == sep + 1 || *end != '\0' || size < 1 || size > 1024 * 1024) {
+            fprintf(stderr, "Error: invalid time series size.\n");
+            goto ON_ERROR;
+          }
+          config->publish.ts_size = (size_t) size * 1024 * 1024;
+          *sep = '\0';
+        }
+        if (*optarg == '\0') {
+          fprintf(stderr, "Error: empty time series directory.\n");
+          goto ON_ERROR;
+        }
+        config->publish.ts_dir = optarg;
+        break;
+      }
+      case 'A':
+      {
+        long size = strtol(optarg, &end, 0);
+
+        if (end == optarg || *end != '\0' || size < 1 || size > 2047) {
+          fprintf(stderr, "Error: invalid archive file size.\n");
+          goto ON_ERROR;
+        }
+        config->publish.archive_size = size * 1024 * 1024;
+        break;
+      }
+
       case 'h':
       {
         goto ON_HELP;
@@ -127,16 +380,33 @@ int parseArgs(int argc, char * argv[], struct cansorella_config * config)
       }
     }
   }
+  if (config->can_cnt == 0)
+    config->can_device[config->can_cnt++] = DEFAULT_CAN_DEVICE;
   return err;
 
 ON_ERROR:
   err = 1;
 ON_HELP:
-  fprintf(err ? stderr : stdout, "usage: %s [-hV] [-d <can-device>] [-r <mqtt remote address>] [-p <mqtt remote port>] [-i <mqtt client-id>] [-t <mqtt topic>] [-q <mqtt QoS>] [-v <log level>] [-f <log facility>]\n", config->prg_name);
+  fprintf(err ? stderr : stdout, "usage: %s [-hV] [-d <can-device>]... [-D <client id>:<name>]... [-b <name>:<absolute>[:<relative>[:<hysteresis>]]]... [-g <name>:<window s>]... [-P <name>:<class>]... [-l <class>:<rate/s>[:<burst>]]... [-H <circuit>]... [-r <mqtt remote address>] [-p <mqtt remote port>] [-i <mqtt client-id>] [-t <mqtt topic>] [-q <mqtt QoS>] [-w <publish window ms> [-s]] [-o <spool file>] [-z <spool size kB>] [-a <archive prefix> [-A <archive file size MB>]] [-L /<live table>] [-M /<socket> | [<host>:]<port>] [-T <directory>[:<size MB>]] [-v <log level>] [-f <log facility>]\n", config->prg_name);
   if (err)
     exit(1);
   fprintf(stdout, "\nOptions:\n");
-  fprintf(stdout, "  -d: CAN bus device. Default is: " DEFAULT_CAN_DEVICE "\n");
+  fprintf(stdout, "  -d: CAN bus device. Repeat to serve several buses (max. %d), each one is read by its own thread.\n"
+                  "      With several buses the interface name is inserted into the topics: <mqtt topic>/<bus>/... Default is: " DEFAULT_CAN_DEVICE "\n", CANSORELLA_MAX_CAN);
+  fprintf(stdout, "  -D: Controller on the bus, identified by its CAN client id. Its parameters are published below <mqtt topic>/<name>.\n"
+                  "      Repeat for several controllers (max. %d). Default: parameters of all controllers are merged.\n", SCBI_MAX_DEVICES);
+  fprintf(stdout, "  -b: Deadband of a parameter. A value is published only if it differs from the last published one by more than\n"
+                  "      <absolute> value units or <relative> per mille, changes against the last direction need <hysteresis> more.\n"
+                  "      Unchanged values are still reposted. Repeat for several parameters (max. %d). Default: every change is published.\n", CANSORELLA_MAX_BANDS);
+  fprintf(stdout, "  -g: Aggregate a parameter over windows of <window s>, one {\"last\",\"min\",\"max\",\"mean\",\"count\"} object is published\n"
+                  "      per window instead of every change. Repeat for several parameters (max. %d).\n", CANSORELLA_MAX_AGGREGATES);
+  fprintf(stdout, "  -P: Priority class (high, normal, low) of a parameter. Pending values of a higher class are published first,\n"
+                  "      a class out of tokens (-l) lets lower classes pass meanwhile.\n"
+                  "      Repeat for several parameters (max. %d). Default: relays high, sensors normal, overview statistics low.\n", CANSORELLA_MAX_PRIOS);
+  fprintf(stdout, "  -l: Limit the publish rate of a class to <rate/s> values, with bursts of up to <burst> values (default: <rate/s>).\n"
+                  "      Values held back are merged, only the latest one is published. Default: unlimited.\n");
+  fprintf(stdout, "  -H: Publish the state of a heating circuit as parameters hc<circuit>_<field>, the heat request as heatreq_temp\n"
+                  "      and heatreq_solar. Repeat for several circuits (max. %d). Default: off\n", CANSORELLA_MAX_HCC);
   fprintf(stdout, "  -v: verbosity information. Available log levels:\n");
   for (idx = 1; idx < LL_COUNT; idx++)
     fprintf(stdout, "%s%s%s", log_get_level_name((enum log_level) idx, TRUE), idx == DEFAULT_LOG_LEVEL ? " (default)" :  "",  idx < LL_COUNT - 1 ? (idx - 1) % 8 == 7 ? ",\n" : ", " : ".\n");
@@ -149,6 +419,21 @@ ON_HELP:
   fprintf(stdout, "  -i: MQTT client id (also used as user name). Default is: " DEFAULT_MQTT_CLIENT_ID "\n");
   fprintf(stdout, "  -t: MQTT topic. Default is: " DEFAULT_MQTT_TOPIC "\n");
   fprintf(stdout, "  -q: MQTT quality of service. Default is: %d\n", DEFAULT_MQTT_QOS);
+  fprintf(stdout, "  -w: Publish window in ms (max. %d). Values arriving within the window are published as one json object per\n"
+                  "      device and type on <mqtt topic>[/<device>]/<type>. Default is: 0 - every value is published on its own.\n", MAX_PUBLISH_WINDOW_MS);
+  fprintf(stdout, "  -s: Publish windowed values on their own topics <mqtt topic>[/<bus>][/<device>]/<type>/<name> as well.\n");
+  fprintf(stdout, "  -o: Spool file. Messages are kept there until the broker took them, pending ones survive a restart.\n"
+                  "      Default: messages are spooled in memory only.\n");
+  fprintf(stdout, "  -z: Spool size in kB, the oldest messages are dropped if it runs full. Default is: %d\n", DEFAULT_SPOOL_SIZE_KB);
+  fprintf(stdout, "  -a: Record all received frames to binary archive files <archive prefix>-<can-device>-<YYYYmmdd-HHMMSS>.sfa.\n"
+                  "      Replay them with sorella-test. Default: no recording.\n");
+  fprintf(stdout, "  -A: Archive file size in MB, a new file is started when it is reached. Default is: %d\n", DEFAULT_ARCHIVE_SIZE_MB);
+  fprintf(stdout, "  -L: Keep the latest value of every parameter in the shared memory object /<live table> for local readers,\n"
+                  "      see sorella-live. Default: off\n");
+  fprintf(stdout, "  -M: Serve all parameters and counters in Prometheus text format on GET /metrics, either on the unix socket\n"
+                  "      /<socket> or on TCP [<host>:]<port> (host defaults to 127.0.0.1). Default: off\n");
+  fprintf(stdout, "  -T: Keep a time series of every parameter in <directory>, limited to <size MB> (default: %d) in total,\n"
+                  "      the oldest samples are overwritten first. Query it with sorella-ts. Default: off\n", DEFAULT_TS_SIZE_MB);
 
   fprintf(stdout, "  -h: Print usage information and exit\n");
   fprintf(stdout, "  -V: Print version information and exit\n");
@@ -3,11 +3,14 @@
 
 #include "ctrl/com/mqtt.h"
 #include "ctrl/logger.h"
+#include "ctrl/scbi_api.h"
+#include "ctrl/scbi_glue.h"
 
 #define DEFAULT_LOG_FACILITY LF_LOCAL0
 #define DEFAULT_LOG_LEVEL    LL_ERROR
 
 #define DEFAULT_CAN_DEVICE "can0"
+#define CANSORELLA_MAX_CAN  4      // max. amount of CAN interfaces served at once
 
 #define DEFAULT_MQTT_REMOTE "localhost"
 #define DEFAULT_MQTT_PORT   1883
@@ -15,15 +18,66 @@
 #define DEFAULT_MQTT_CLIENT_ID "cansorella"
 #define DEFAULT_MQTT_TOPIC     "MTDC"
 #define DEFAULT_MQTT_QOS       2
+#define MAX_PUBLISH_WINDOW_MS  60000
+#define DEFAULT_SPOOL_SIZE_KB  1024
+#define DEFAULT_ARCHIVE_SIZE_MB 16
+#define DEFAULT_TS_SIZE_MB      64
+#define CANSORELLA_MAX_BANDS   16  // max. amount of parameters with a deadband
+#define CANSORELLA_MAX_AGGREGATES 16  // max. amount of aggregated parameters
+#define CANSORELLA_MAX_PRIOS   16  // max. amount of parameters with a changed priority class
+#define CANSORELLA_MAX_HCC      4  // max. amount of heating circuits whose state is published
 
 
+struct cansorella_device
+{
+    uint8_t            client;
+    const char *       name;
+};
+
+struct cansorella_band
+{
+    const char *       name;
+    struct scbi_deadband band;
+};
+
+struct cansorella_aggregate
+{
+    const char *       name;
+    uint32_t           window_s;
+};
+
+struct cansorella_prio
+{
+    const char *       name;
+    enum scbi_priority prio;
+};
+
+struct cansorella_limit
+{
+    uint32_t           rate;    // zero: unlimited
+    uint32_t           burst;
+};
+
 struct cansorella_config
 {
     const char *       prg_name;
     enum log_facility  log_facility;
     enum log_level     log_level;
-    char *             can_device;
+    const char *       can_device[CANSORELLA_MAX_CAN];
+    int                can_cnt;
     struct mqtt_config mqtt;
+    struct scbi_glue_config publish;
+    struct cansorella_device dev[SCBI_MAX_DEVICES];
+    int                dev_cnt;
+    struct cansorella_band band[CANSORELLA_MAX_BANDS];
+    int                band_cnt;
+    struct cansorella_aggregate agg[CANSORELLA_MAX_AGGREGATES];
+    int                agg_cnt;
+    struct cansorella_prio prio[CANSORELLA_MAX_PRIOS];
+    int                prio_cnt;
+    struct cansorella_limit limit[SCBI_PRIO_CNT];
+    uint8_t            hcc[CANSORELLA_MAX_HCC];
+    int                hcc_cnt;
 };
 
 int parseArgs(int argc, char * argv[], struct cansorella_config * config);
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include "ctrl/exporter.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define EXPORTER_PAGE_MIN 4096
+#define EXPORTER_EVENTS   8
+
+struct exporter_page
+{
+  char *   buf;
+  size_t   len;
+  size_t   cap;
+};
+
+struct exporter_client
+{
+  int                  fd;        // -1: slot unused
+  time_t               since;
+  size_t               req_len;
+  char                 req[EXPORTER_REQUEST_LEN];
+  struct exporter_page resp;
+  size_t               sent;
+};
+
+struct exporter
+{
+  int                    epfd;
+  int                    lfd;
+  char *                 path;     // of a unix socket, removed on close
+  exporter_render_fn     render;
+  void *                 ctx;
+  struct exporter_page   body;     // reused for every scrape
+  struct exporter_client client[EXPORTER_MAX_CLIENTS];
+};
+
+
+static time_t exporter_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+static int exporter_reserve(struct exporter_page * page, size_t len)
+{
+  size_t cap = page->cap ? page->cap : EXPORTER_PAGE_MIN;
+  char * buf;
+
+  if (page->len + len < page->cap)
+    return 0;
+  while (cap <= page->len + len)
+    cap *= 2;
+  buf = realloc(page->buf, cap);
+  if (buf == NULL)
+    return -1;
+  page->buf = buf;
+  page->cap = cap;
+  return 0;
+}
+
+static void exporter_append(struct exporter_page * page, const char * data, size_t len)
+{
+  if (exporter_reserve(page, len) == 0)
+  {
+    memcpy(page->buf + page->len, data, len);
+    page->len += len;
+  }
+}
+
+void exporter_printf(struct exporter_page * page, const char * format, ...)
+{
+  va_list ap;
+  int     len;
+
+  va_start(ap, format);
+  len = vsnprintf(page->buf ? page->buf + page->len : NULL, page->buf ? page->cap - page->len : 0, format, ap);
+  va_end(ap);
+  if (len < 0 || page->buf == NULL || page->len + len >= page->cap)
+  {
+    if (len < 0 || exporter_reserve(page, len) < 0)
+      return;
+    va_start(ap, format);
+    vsnprintf(page->buf + page->len, page->cap - page->len, format, ap);
+    va_end(ap);
+  }
+  page->len += len;
+}
+
+void exporter_label(struct exporter_page * page, const char * value)
+{
+  for (; value && *value; value++)
+  {
+    if (*value == '\\' || *value == '"')
+      exporter_append(page, "\\", 1);
+    if (*value == '\n')
+      exporter_append(page, "\\n", 2);
+    else
+      exporter_append(page, value, 1);
+  }
+}
+
+
+static int exporter_listen(struct exporter * ex, const char * addr)
+{
+  if (*addr == '/')
+  {
+    struct sockaddr_un sun = { .sun_family = AF_UNIX };
+
+    if (strlen(addr) >= sizeof(sun.sun_path))
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    strcpy(sun.sun_path, addr);
+    ex->lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ex->lfd < 0)
+      return -1;
+    unlink(addr);                 /* stale socket of a former run */
+    if (bind(ex->lfd, (struct sockaddr *) &sun, sizeof(sun)) < 0)
+      return -1;
+    ex->path = strdup(addr);
+  }
+  else
+  {
+    struct addrinfo   hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE | AI_NUMERICSERV };
+    struct addrinfo * res;
+    const char *      port = strrchr(addr, ':');
+    char              host[256] = "127.0.0.1";
+    int               rc;
+
+    if (port)
+    {
+      if (*addr == '[' && port > addr && port[-1] == ']')   /* [<ipv6 address>]:<port> */
+        snprintf(host, sizeof(host), "%.*s", (int) (port - addr - 2), addr + 1);
+      else
+        snprintf(host, sizeof(host), "%.*s", (int) (port - addr), addr);
+      port++;
+    }
+    else
+      port = addr;
+    rc = getaddrinfo(host, port, &hints, &res);
+    if (rc != 0)
+    {
+      errno = rc == EAI_SYSTEM ? errno : EINVAL;
+      return -1;
+    }
+    ex->lfd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ex->lfd >= 0)
+    {
+      setsockopt(ex->lfd, SOL_SOCKET, SO_REUSEADDR, &(int) { 1 }, sizeof(int));
+      rc = bind(ex->lfd, res->ai_addr, res->ai_addrlen);
+    }
+    freeaddrinfo(res);
+    if (ex->lfd < 0 || rc < 0)
+      return -1;
+  }
+  return listen(ex->lfd, EXPORTER_MAX_CLIENTS);
+}
+
+struct exporter * exporter_open(const char * addr, exporter_render_fn render, void * ctx)
+{
+  struct exporter *  ex = calloc(1, sizeof(struct exporter));
+  struct epoll_event ev = { .events = EPOLLIN, .data.u32 = 0 };
+
+  if (ex == NULL)
+    return NULL;
+  ex->lfd    = -1;
+  ex->render = render;
+  ex->ctx    = ctx;
+  for (int i = 0; i < EXPORTER_MAX_CLIENTS; i++)
+    ex->client[i].fd = -1;
+  ex->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (ex->epfd < 0 || exporter_listen(ex, addr) < 0 || epoll_ctl(ex->epfd, EPOLL_CTL_ADD, ex->lfd, &ev) < 0)
+  {
+    int err = errno;
+
+    exporter_close(ex);
+    errno = err;
+    return NULL;
+  }
+  return ex;
+}
+
+int exporter_fd(struct exporter * ex)
+{
+  return ex->epfd;
+}
+
+
+static void exporter_drop(struct exporter * ex, struct exporter_client * cl)
+{
+  epoll_ctl(ex->epfd, EPOLL_CTL_DEL, cl->fd, NULL);
+  close(cl->fd);
+  cl->fd = -1;
+  cl->resp.len = 0;
+}
+
+static void exporter_accept(struct exporter * ex)
+{
+  int fd;
+
+  while ((fd = accept4(ex->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    int i;
+
+    for (i = 0; i < EXPORTER_MAX_CLIENTS && ex->client[i].fd >= 0; i++);
+    if (i == EXPORTER_MAX_CLIENTS)
+    {
+      close(fd);               /* busy, the scraper retries on its next interval */
+      continue;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i + 1 };
+    if (epoll_ctl(ex->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+      close(fd);
+      continue;
+    }
+    ex->client[i].fd      = fd;
+    ex->client[i].since   = exporter_now();
+    ex->client[i].req_len = 0;
+    ex->client[i].sent    = 0;
+  }
+}
+
+static void exporter_respond(struct exporter * ex, struct exporter_client * cl, const char * status, const struct exporter_page * body)
+{
+  exporter_printf(&cl->resp, "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                  "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, body ? body->len : strlen(status) + 1);
+  if (body)
+    exporter_append(&cl->resp, body->buf, body->len);
+  else
+    exporter_printf(&cl->resp, "%s\n", status);
+  cl->sent = 0;
+  epoll_ctl(ex->epfd, EPOLL_CTL_MOD, cl->fd, &(struct epoll_event) { .events = EPOLLOUT, .data.u32 = cl - ex->client + 1 });
+}
+
+/* the request head is complete once an empty line arrived, only its first line is of interest */
+static void exporter_read(struct exporter * ex, struct exporter_client * cl)
+{
+  ssize_t len = read(cl->fd, cl->req + cl->req_len, sizeof(cl->req) - 1 - cl->req_len);
+
+  if (len <= 0)
+  {
+    if (len == 0 || (errno != EAGAIN && errno != EINTR))
+      exporter_drop(ex, cl);
+    return;
+  }
+  cl->req_len += len;
+  cl->req[cl->req_len] = '\0';
+  if (strstr(cl->req, "\r\n\r\n") == NULL && strstr(cl->req, "\n\n") == NULL)
+  {
+    if (cl->req_len == sizeof(cl->req) - 1)
+      exporter_respond(ex, cl, "431 Request Header Fields Too Large", NULL);
+    return;
+  }
+  if (strncmp(cl->req, "GET ", 4) != 0)
+    exporter_respond(ex, cl, "405 Method Not Allowed", NULL);
+  else if (strncmp(cl->req + 4, "/metrics ", 9) != 0 && strncmp(cl->req + 4, "/ ", 2) != 0)
+    exporter_respond(ex, cl, "404 Not Found", NULL);
+  else
+  {
+    ex->body.len = 0;
+    ex->render(ex->ctx, &ex->body);
+    exporter_respond(ex, cl, "200 OK", &ex->body);
+  }
+}
+
+static void exporter_write(struct exporter * ex, struct exporter_client * cl)
+{
+  ssize_t len = write(cl->fd, cl->resp.buf + cl->sent, cl->resp.len - cl->sent);
+
+  if (len < 0)
+  {
+    if (errno != EAGAIN && errno != EINTR)
+      exporter_drop(ex, cl);
+    return;
+  }
+  cl->sent += len;
+  if (cl->sent == cl->resp.len)
+    exporter_drop(ex, cl);
+}
+
+/* service all sockets that are ready, never waits */
+void exporter_update(struct exporter * ex)
+{
+  struct epoll_event ev[EXPORTER_EVENTS];
+  int                cnt = epoll_wait(ex->epfd, ev, EXPORTER_EVENTS, 0);
+
+  for (int i = 0; i < cnt; i++)
+  {
+    struct exporter_client * cl;
+
+    if (ev[i].data.u32 == 0)
+    {
+      exporter_accept(ex);
+      continue;
+    }
+    cl = &ex->client[ev[i].data.u32 - 1];
+    if (cl->fd < 0)
+      continue;
+    if (ev[i].events & (EPOLLERR | EPOLLHUP))
+      exporter_drop(ex, cl);
+    else if (ev[i].events & EPOLLOUT)
+      exporter_write(ex, cl);
+    else if (ev[i].events & EPOLLIN)
+      exporter_read(ex, cl);
+  }
+}
+
+/* drop clients that didn't finish within EXPORTER_TIMEOUT_SEC, call periodically */
+void exporter_expire(struct exporter * ex)
+{
+  time_t now = exporter_now();
+
+  for (int i = 0; i < EXPORTER_MAX_CLIENTS; i++)
+  {
+    if (ex->client[i].fd >= 0 && now - ex->client[i].since > EXPORTER_TIMEOUT_SEC)
+      exporter_drop(ex, &ex->client[i]);
+  }
+}
+
+void exporter_close(struct exporter * ex)
+{
+  if (ex)
+  {
+    for (int i = 0; i < EXPORTER_MAX_CLIENTS; i++)
+    {
+      if (ex->client[i].fd >= 0)
+        exporter_drop(ex, &ex->client[i]);
+      free(ex->client[i].resp.buf);
+    }
+    if (ex->lfd >= 0)
+      close(ex->lfd);
+    if (ex->path)
+    {
+      unlink(ex->path);
+      free(ex->path);
+    }
+    if (ex->epfd >= 0)
+      close(ex->epfd);
+    free(ex->body.buf);
+    free(ex);
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef _CTRL_EXPORTER__H
+#define _CTRL_EXPORTER__H
+
+#include <stddef.h>
+#include <time.h>
+
+/* minimal HTTP/1.0 server for pull based metrics (Prometheus text format) on a TCP or unix socket.
+ * Single threaded and non-blocking: all sockets are watched by the exporters own epoll instance,
+ * whose descriptor the owner adds to its event loop and services with exporter_update when it turns readable.
+ * Every GET of /metrics renders a fresh page through the callback, the connection is closed after the response.
+ */
+
+#define EXPORTER_MAX_CLIENTS  8
+#define EXPORTER_REQUEST_LEN  1024   // longer request heads are rejected
+#define EXPORTER_TIMEOUT_SEC  10     // clients not done by then are dropped
+
+struct exporter;
+struct exporter_page;
+
+typedef void (* exporter_render_fn) (void * ctx, struct exporter_page * page);
+
+/* addr: /<path> for a unix socket, [<host>:]<port> for TCP (default host 127.0.0.1) */
+struct exporter * exporter_open(const char * addr, exporter_render_fn render, void * ctx);
+int  exporter_fd(struct exporter * ex);
+void exporter_update(struct exporter * ex);
+void exporter_expire(struct exporter * ex);
+void exporter_close(struct exporter * ex);
+
+/* page content, both fail silently (the response is truncated) if memory runs out */
+void exporter_printf(struct exporter_page * page, const char * format, ...) __attribute__((format(printf, 2, 3)));
+void exporter_label(struct exporter_page * page, const char * value);   // escaped label value
+
+#endif   // _CTRL_EXPORTER__H
@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+#include "ctrl/frame_archive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FA_REC_MAX_LEN (1 + 4 + 5 + CAN_MAX_DLEN)   // header, can id, delta varint, data
+#define FA_NAME_LEN    256
+
+struct fa_writer
+{
+  const char *  prefix;
+  char          port[16];
+  int64_t       base_ms;
+  size_t        file_size;
+  int           fd;
+  size_t        blocks;        // complete blocks in the current file
+  int           started;
+  scbi_time     last_recvd;
+  uint64_t      last_ms;       // extended time of the last frame
+  uint64_t      block_ms;      // time of the last frame in the current block, deltas refer to it
+  size_t        dict_cnt;
+  uint32_t      dict[FA_DICT_SIZE];
+  uint8_t       block[FA_BLOCK_SIZE];
+};
+
+struct fa_reader
+{
+  int                           fd;
+  const uint8_t *               map;
+  size_t                        len;
+  size_t                        blocks;  // blocks holding frames
+  const struct fa_file_header * hdr;
+  size_t                        blk;
+  size_t                        pos;     // read position within the current block, 0: block not entered yet
+  size_t                        idx;
+  uint64_t                      ms;
+  uint64_t                      skip_until;
+  size_t                        dict_cnt;
+  uint32_t                      dict[FA_DICT_SIZE];
+};
+
+
+/* helper fcts */
+
+static void fa_put_le32(uint8_t * p, uint32_t v)
+{
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t fa_get_le32(const uint8_t * p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static size_t fa_put_varint(uint8_t * p, uint32_t v)
+{
+  size_t n = 0;
+
+  while (v >= 0x80)
+  {
+    p[n++] = v | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+  return n;
+}
+
+static struct fa_block_header * fa_block_header(uint8_t * block)
+{
+  return (struct fa_block_header *) block;
+}
+
+
+/* recording */
+
+static int fa_writer_new_file(struct fa_writer * w)
+{
+  char                  fname[FA_NAME_LEN];
+  char                  stamp[32];
+  time_t                now = time(NULL);
+  struct tm             tm;
+  uint8_t               head[FA_BLOCK_SIZE] = { 0 };
+  struct fa_file_header * hdr = (struct fa_file_header *) head;
+
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime_r(&now, &tm));
+  /* never overwrite a recording, files started within the same second get a sequence number */
+  for (int seq = 0; ; seq++)
+  {
+    int len = seq ? snprintf(fname, sizeof(fname), "%s-%s-%s-%d" FA_FILE_EXT, w->prefix, w->port, stamp, seq)
+                  : snprintf(fname, sizeof(fname), "%s-%s-%s" FA_FILE_EXT, w->prefix, w->port, stamp);
+    if (len >= (int) sizeof(fname))
+      return -1;
+    w->fd = open(fname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (w->fd >= 0)
+      break;
+    if (errno != EEXIST)
+      return -1;
+  }
+  hdr->magic      = FA_MAGIC;
+  hdr->block_size = FA_BLOCK_SIZE;
+  hdr->base_ms    = w->base_ms;
+  memcpy(hdr->port, w->port, sizeof(hdr->port));
+  w->blocks = 0;
+  return pwrite(w->fd, head, sizeof(head), 0) == sizeof(head) ? 0 : -1;
+}
+
+static int fa_writer_write_block(struct fa_writer * w)
+{
+  if (pwrite(w->fd, w->block, FA_BLOCK_SIZE, (w->blocks + 1) * FA_BLOCK_SIZE) != FA_BLOCK_SIZE)
+    return -1;
+  return 0;
+}
+
+/* a full block goes to disk, the next one starts with an empty dictionary. Rolls over to a new file if due. */
+static int fa_writer_next_block(struct fa_writer * w)
+{
+  int rc = w->fd >= 0 ? fa_writer_write_block(w) : -1;
+
+  w->blocks++;
+  memset(w->block, 0, FA_BLOCK_SIZE);
+  w->dict_cnt = 0;
+  if (w->fd < 0 || (w->blocks + 2) * FA_BLOCK_SIZE > w->file_size)
+  {
+    if (w->fd >= 0)
+      close(w->fd);
+    if (fa_writer_new_file(w) < 0)
+      rc = -1;
+  }
+  return rc;
+}
+
+struct fa_writer * fa_writer_open(const char * prefix, const char * port, int64_t base_ms, size_t file_size)
+{
+  struct fa_writer * w = calloc(1, sizeof(struct fa_writer));
+
+  if (w == NULL)
+    return NULL;
+  w->fd        = -1;
+  w->prefix    = prefix;
+  strncpy(w->port, port, sizeof(w->port) - 1);
+  w->base_ms   = base_ms;
+  w->file_size = file_size < 2 * FA_BLOCK_SIZE ? 2 * FA_BLOCK_SIZE : file_size;
+  if (fa_writer_new_file(w) < 0)
+  {
+    if (w->fd >= 0)
+      close(w->fd);
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+/* appends frames to the current block - memory only unless the block fills up */
+int fa_writer_put(struct fa_writer * w, const struct scbi_frame * frame, size_t cnt)
+{
+  int rc = 0;
+
+  for (size_t i = 0; i < cnt; i++, frame++)
+  {
+    struct fa_block_header * bh = fa_block_header(w->block);
+    uint32_t delta, id = frame->msg.can_id;
+    uint8_t  len = frame->msg.len > CAN_MAX_DLEN ? CAN_MAX_DLEN : frame->msg.len;
+    size_t   di;
+    uint8_t * p;
+
+    /* scbi_time wraps after 49 days, archive times don't */
+    delta = w->started ? frame->recvd - w->last_recvd : 0;
+    if (delta > INT32_MAX)   /* out of order, keep times monotonic */
+      delta = 0;
+    w->last_ms   += delta;
+    w->last_recvd = frame->recvd;
+    if (!w->started)
+    {
+      w->last_ms = frame->recvd;
+      w->started = 1;
+    }
+
+    for (di = 0; di < w->dict_cnt && w->dict[di] != id; di++)
+      ;
+    if (bh->used + FA_REC_MAX_LEN > FA_BLOCK_SIZE || (di == w->dict_cnt && di == FA_DICT_SIZE))
+    {
+      if (fa_writer_next_block(w) < 0)
+        rc = -1;
+      di = 0;
+    }
+    if (bh->count == 0)
+    {
+      bh->magic    = FA_BLOCK_MAGIC;
+      bh->used     = sizeof(*bh);
+      bh->first_ms = w->last_ms;
+      w->block_ms  = w->last_ms;
+    }
+
+    p = w->block + bh->used;
+    if (di == w->dict_cnt)
+    {
+      *p++ = len | FA_REC_NEW_ID;
+      fa_put_le32(p, id);
+      p += 4;
+      w->dict[w->dict_cnt++] = id;
+    }
+    else
+    {
+      *p++ = len;
+      *p++ = di;
+    }
+    p += fa_put_varint(p, w->last_ms - w->block_ms);
+    w->block_ms = w->last_ms;
+    memcpy(p, frame->msg.data, len);
+    p += len;
+    bh->used = p - w->block;
+    bh->count++;
+  }
+  return rc;
+}
+
+void fa_writer_close(struct fa_writer * w)
+{
+  if (w)
+  {
+    if (w->fd >= 0)
+    {
+      if (fa_block_header(w->block)->count)
+        fa_writer_write_block(w);
+      close(w->fd);
+    }
+    free(w);
+  }
+}
+
+
+/* replay */
+
+static const struct fa_block_header * fa_reader_block(struct fa_reader * r, size_t blk)
+{
+  return (const struct fa_block_header *) (r->map + (blk + 1) * FA_BLOCK_SIZE);
+}
+
+static int fa_reader_block_valid(struct fa_reader * r, size_t blk)
+{
+  const struct fa_block_header * bh = fa_reader_block(r, blk);
+  return bh->magic == FA_BLOCK_MAGIC && bh->count > 0 && bh->used >= sizeof(*bh) && bh->used <= FA_BLOCK_SIZE;
+}
+
+struct fa_reader * fa_reader_open(const char * fname)
+{
+  struct fa_reader * r = calloc(1, sizeof(struct fa_reader));
+  struct stat st;
+
+  if (r == NULL)
+    return NULL;
+  r->fd = open(fname, O_RDONLY | O_CLOEXEC);
+  if (r->fd < 0 || fstat(r->fd, &st) < 0 || (size_t) st.st_size < FA_BLOCK_SIZE)
+    goto ON_ERROR;
+  r->len = st.st_size;
+  r->map = mmap(NULL, r->len, PROT_READ, MAP_PRIVATE, r->fd, 0);
+  if (r->map == MAP_FAILED)
+  {
+    r->map = NULL;
+    goto ON_ERROR;
+  }
+  r->hdr = (const struct fa_file_header *) r->map;
+  if (r->hdr->magic != FA_MAGIC || r->hdr->block_size != FA_BLOCK_SIZE)
+    goto ON_ERROR;
+  madvise((void *) r->map, r->len, MADV_SEQUENTIAL);
+
+  /* blocks are written in order - the valid ones form a prefix, an interrupted recording may leave garbage behind */
+  r->blocks = r->len / FA_BLOCK_SIZE - 1;
+  while (r->blocks > 0 && !fa_reader_block_valid(r, r->blocks - 1))
+    r->blocks--;
+  return r;
+
+ON_ERROR:
+  fa_reader_close(r);
+  return NULL;
+}
+
+const struct fa_file_header * fa_reader_header(struct fa_reader * r)
+{
+  return r->hdr;
+}
+
+/* binary search the block index for the last block starting at or before ms */
+void fa_reader_seek(struct fa_reader * r, uint64_t ms)
+{
+  size_t lo = 0, hi = r->blocks;
+
+  while (hi - lo > 1)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (fa_reader_block(r, mid)->first_ms <= ms)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  r->blk = lo;
+  r->pos = 0;
+  r->skip_until = ms;
+}
+
+/* returns 0 and the next frame with its extended time, -1 at the end of the file */
+int fa_reader_next(struct fa_reader * r, struct scbi_frame * frame, uint64_t * ms)
+{
+  while (r->blk < r->blocks)
+  {
+    const struct fa_block_header * bh = fa_reader_block(r, r->blk);
+    const uint8_t * b = (const uint8_t *) bh;
+    uint32_t id, delta = 0;
+    uint8_t  hdr, len;
+    int      shift = 0;
+
+    if (r->pos == 0)
+    {
+      if (!fa_reader_block_valid(r, r->blk))
+        break;
+      r->pos = sizeof(*bh);
+      r->idx = 0;
+      r->ms = bh->first_ms;
+      r->dict_cnt = 0;
+    }
+    if (r->idx >= bh->count || r->pos + 2 > bh->used)
+      goto NEXT_BLOCK;
+
+    hdr = b[r->pos++];
+    len = hdr & FA_REC_LEN_MASK;
+    if (hdr & FA_REC_NEW_ID)
+    {
+      if (r->pos + 4 > bh->used || r->dict_cnt == FA_DICT_SIZE)
+        goto NEXT_BLOCK;
+      id = fa_get_le32(&b[r->pos]);
+      r->pos += 4;
+      r->dict[r->dict_cnt++] = id;
+    }
+    else
+    {
+      if (b[r->pos] >= r->dict_cnt)
+        goto NEXT_BLOCK;
+      id = r->dict[b[r->pos++]];
+    }
+    do
+    {
+      if (r->pos >= bh->used || shift > 28)
+        goto NEXT_BLOCK;
+      delta |= (uint32_t) (b[r->pos] & 0x7F) << shift;
+      shift += 7;
+    } while (b[r->pos++] & 0x80);
+    if (len > CAN_MAX_DLEN || r->pos + len > bh->used)
+      goto NEXT_BLOCK;
+    r->ms += delta;
+    r->idx++;
+
+    if (r->ms < r->skip_until)
+    {
+      r->pos += len;
+      continue;
+    }
+    memset(frame, 0, sizeof(*frame));
+    frame->msg.can_id = id;
+    frame->msg.len    = len;
+    memcpy(frame->msg.data, &b[r->pos], len);
+    frame->recvd      = (scbi_time) r->ms;
+    r->pos += len;
+    if (ms)
+      *ms = r->ms;
+    return 0;
+
+NEXT_BLOCK:     /* block done or damaged */
+    r->blk++;
+    r->pos = 0;
+  }
+  return -1;
+}
+
+void fa_reader_close(struct fa_reader * r)
+{
+  if (r)
+  {
+    if (r->map)
+      munmap((void *) r->map, r->len);
+    if (r->fd >= 0)
+      close(r->fd);
+    free(r);
+  }
+}
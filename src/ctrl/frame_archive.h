@@ -0,0 +1,60 @@
+#ifndef _CTRL_FRAME_ARCHIVE__H
+#define _CTRL_FRAME_ARCHIVE__H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ctrl/scbi_api.h"
+
+/* compact binary archive of received CAN frames.
+ *
+ * A file consists of a header block followed by fixed size blocks. Every block starts with the
+ * time of its first frame, so the block headers form a sparse time index that is binary searched
+ * in place. Within a block frames are stored as
+ *
+ *   [len | FA_REC_NEW_ID] [can id (4 bytes LE) | dictionary index (1 byte)] [time delta ms, LEB128] [data]
+ *
+ * CAN ids are dictionary encoded per block, so any block can be decoded on its own.
+ * Times are milliseconds since the recording started (see fa_file_header.base_ms), extended to 64 bit.
+ */
+
+#define FA_MAGIC          0x31414653  // "SFA1"
+#define FA_BLOCK_MAGIC    0x4B4C4246  // "FBLK"
+#define FA_BLOCK_SIZE     4096
+#define FA_FILE_EXT       ".sfa"
+#define FA_REC_NEW_ID     0x10
+#define FA_REC_LEN_MASK   0x0F
+#define FA_DICT_SIZE      255
+
+struct fa_file_header
+{
+  uint32_t magic;
+  uint32_t block_size;
+  int64_t  base_ms;       // wall clock (ms since epoch) of frame time zero
+  char     port[16];      // CAN interface the frames were recorded on
+};
+
+struct fa_block_header
+{
+  uint32_t magic;
+  uint16_t count;         // frames in this block
+  uint16_t used;          // bytes in use incl. this header
+  uint64_t first_ms;      // time of the blocks first frame
+};
+
+struct fa_writer;
+struct fa_reader;
+
+/* recording: files <prefix>-<port>-<YYYYmmdd-HHMMSS>.sfa, a new one is started when file_size is reached */
+struct fa_writer * fa_writer_open(const char * prefix, const char * port, int64_t base_ms, size_t file_size);
+int  fa_writer_put(struct fa_writer * w, const struct scbi_frame * frame, size_t cnt);
+void fa_writer_close(struct fa_writer * w);
+
+/* replay: the file is mapped, fa_reader_seek positions on the first frame at or after a time */
+struct fa_reader * fa_reader_open(const char * fname);
+const struct fa_file_header * fa_reader_header(struct fa_reader * r);
+void fa_reader_seek(struct fa_reader * r, uint64_t ms);
+int  fa_reader_next(struct fa_reader * r, struct scbi_frame * frame, uint64_t * ms);
+void fa_reader_close(struct fa_reader * r);
+
+#endif   // _CTRL_FRAME_ARCHIVE__H
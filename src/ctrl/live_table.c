@@ -0,0 +1,241 @@
+#include "ctrl/live_table.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LT_READ_RETRIES 1000   // a reader gives up on a slot the writer doesn't finish within as many attempts
+
+struct lt_writer
+{
+  char *             name;
+  size_t             size;
+  struct lt_header * hdr;
+  struct lt_slot *   slot;
+  size_t             bus_cnt;
+  uint32_t           base[];      /* first slot of every bus, base[bus_cnt] is the slot count */
+};
+
+struct lt_reader
+{
+  size_t             size;
+  struct lt_header * hdr;
+  struct lt_slot *   slot;
+};
+
+
+static void lt_copy(char * dst, const char * src, size_t size)
+{
+  if (src)
+  {
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+  }
+}
+
+struct lt_writer * lt_writer_open(const char * name, struct scbi_handle ** scbi, const char ** port, size_t cnt)
+{
+  const struct scbi_param * param;
+  struct scbi_param_stats   stats;
+  struct lt_writer *        w;
+  uint32_t                  params = 0, slot = 0;
+  int                       fd;
+
+  w = calloc(1, sizeof(struct lt_writer) + (cnt + 1) * sizeof(uint32_t));
+  if (w == NULL)
+    return NULL;
+  for (size_t i = 0; i < cnt; i++)
+  {
+    w->base[i] = params;
+    for (size_t idx = 0; scbi_get_param_stats(scbi[i], idx, &param, &stats) == 0; idx++)
+      params++;
+  }
+  w->base[cnt] = params;
+  w->bus_cnt = cnt;
+  w->size = sizeof(struct lt_header) + params * sizeof(struct lt_slot);
+  w->name = strdup(name);
+  if (w->name == NULL)
+  {
+    free(w);
+    return NULL;
+  }
+
+  /* a leftover of a crashed writer is replaced, readers still holding it keep their mapping */
+  shm_unlink(name);
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0 || ftruncate(fd, w->size) < 0 ||
+      (w->hdr = mmap(NULL, w->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+  {
+    int err = errno;
+
+    w->hdr = NULL;
+    if (fd >= 0)
+      close(fd);
+    lt_writer_close(w);
+    errno = err;
+    return NULL;
+  }
+  close(fd);
+  w->slot = (struct lt_slot *) (w->hdr + 1);
+
+  for (size_t i = 0; i < cnt; i++)
+  {
+    for (size_t idx = 0; scbi_get_param_stats(scbi[i], idx, &param, &stats) == 0; idx++, slot++)
+    {
+      w->slot[slot].type = param->type;
+      lt_copy(w->slot[slot].bus, port[i], LT_BUS_LEN);
+      lt_copy(w->slot[slot].device, param->device, LT_DEVICE_LEN);
+      lt_copy(w->slot[slot].name, param->name, LT_NAME_LEN);
+    }
+  }
+  w->hdr->slot_size = sizeof(struct lt_slot);
+  w->hdr->slot_cnt  = params;
+  w->hdr->pid       = getpid();
+  atomic_thread_fence(memory_order_release);
+  w->hdr->magic     = LT_MAGIC;
+  return w;
+}
+
+void lt_writer_put(struct lt_writer * w, size_t bus, int idx, const struct scbi_param * param, int64_t now_ms)
+{
+  struct lt_slot * slot;
+  uint32_t         seq;
+
+  if (bus >= w->bus_cnt || idx < 0 || w->base[bus] + (uint32_t) idx >= w->base[bus + 1])
+    return;           /* registered after the table was set up */
+  slot = &w->slot[w->base[bus] + idx];
+  seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  slot->val.value      = param->value;
+  slot->val.updates++;
+  slot->val.updated_ms = now_ms;
+  slot->val.aggregate  = param->aggregate;
+  atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+void lt_writer_alive(struct lt_writer * w, int64_t now_ms)
+{
+  atomic_store_explicit(&w->hdr->alive_ms, now_ms, memory_order_relaxed);
+}
+
+void lt_writer_close(struct lt_writer * w)
+{
+  if (w)
+  {
+    if (w->hdr)
+      munmap(w->hdr, w->size);
+    if (w->name)
+    {
+      shm_unlink(w->name);
+      free(w->name);
+    }
+    free(w);
+  }
+}
+
+
+struct lt_reader * lt_reader_open(const char * name)
+{
+  struct lt_reader * r = calloc(1, sizeof(struct lt_reader));
+  struct stat        st;
+  int                fd, err;
+
+  if (r == NULL)
+    return NULL;
+  fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0 || fstat(fd, &st) < 0)
+    goto ON_ERROR;
+  r->size = st.st_size;
+  errno = EPROTO;
+  if (r->size < sizeof(struct lt_header))
+    goto ON_ERROR;
+  r->hdr = mmap(NULL, r->size, PROT_READ, MAP_SHARED, fd, 0);
+  if (r->hdr == MAP_FAILED)
+  {
+    r->hdr = NULL;
+    goto ON_ERROR;
+  }
+  close(fd);
+  fd = -1;
+  errno = EAGAIN;     /* writer still initializing */
+  if (r->hdr->magic != LT_MAGIC)
+    goto ON_ERROR;
+  atomic_thread_fence(memory_order_acquire);
+  errno = EPROTO;
+  if (r->hdr->slot_size != sizeof(struct lt_slot) || sizeof(struct lt_header) + (size_t) r->hdr->slot_cnt * sizeof(struct lt_slot) > r->size)
+    goto ON_ERROR;
+  r->slot = (struct lt_slot *) (r->hdr + 1);
+  return r;
+
+ON_ERROR:
+  err = errno;
+  if (fd >= 0)
+    close(fd);
+  lt_reader_close(r);
+  errno = err;
+  return NULL;
+}
+
+const struct lt_header * lt_reader_header(struct lt_reader * r)
+{
+  return r->hdr;
+}
+
+const struct lt_slot * lt_reader_slot(struct lt_reader * r, size_t idx)
+{
+  return idx < r->hdr->slot_cnt ? &r->slot[idx] : NULL;
+}
+
+/* slot index of a parameter, bus NULL or empty for the first bus that has it, device NULL or empty for
+ * SCBI_DEVICE_ANY, -1 if there is none */
+int lt_reader_find(struct lt_reader * r, const char * bus, const char * device, const char * name)
+{
+  for (uint32_t i = 0; i < r->hdr->slot_cnt; i++)
+  {
+    if (strncmp(r->slot[i].name, name, LT_NAME_LEN) == 0 && strncmp(r->slot[i].device, device ? device : "", LT_DEVICE_LEN) == 0 &&
+        (bus == NULL || bus[0] == '\0' || strncmp(r->slot[i].bus, bus, LT_BUS_LEN) == 0))
+      return i;
+  }
+  return -1;
+}
+
+/* consistent copy of a slots value, -1 on an invalid index or if the writer is stuck in the middle of an update */
+int lt_reader_get(struct lt_reader * r, size_t idx, struct lt_value * val)
+{
+  const struct lt_slot * slot = lt_reader_slot(r, idx);
+
+  if (slot == NULL)
+    return -1;
+  for (int i = 0; i < LT_READ_RETRIES; i++)
+  {
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq & 1)
+    {
+      sched_yield();
+      continue;
+    }
+    *val = slot->val;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq)
+      return 0;
+  }
+  errno = EBUSY;
+  return -1;
+}
+
+void lt_reader_close(struct lt_reader * r)
+{
+  if (r)
+  {
+    if (r->hdr)
+      munmap(r->hdr, r->size);
+    free(r);
+  }
+}
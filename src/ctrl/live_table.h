@@ -0,0 +1,72 @@
+#ifndef _CTRL_LIVE_TABLE__H
+#define _CTRL_LIVE_TABLE__H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "ctrl/scbi_api.h"
+
+/* live values of all registered parameters in a POSIX shared memory object, for readers on the same host.
+ *
+ * The object holds a header followed by one slot per parameter and bus, the slots of a bus in the order its
+ * parameters were registered. Bus, name, device and type of a slot are written
+ * once before the header is marked valid, the value part is guarded by the slots sequence counter (seqlock):
+ * the writer makes it odd while updating and even again afterwards. A reader copies the slot and retries if
+ * the counter was odd or changed meanwhile - the writer never waits for readers, readers never block each other.
+ * Slots are cache line aligned, so updates of one parameter don't disturb readers of another.
+ */
+
+#define LT_MAGIC       0x32544C53  // "SLT2"
+#define LT_CACHELINE   64
+#define LT_NAME_LEN    64
+#define LT_DEVICE_LEN  24
+#define LT_BUS_LEN     16          // IFNAMSIZ
+
+struct lt_header
+{
+  uint32_t         magic;           // set last, once all slots are initialized
+  uint32_t         slot_size;
+  uint32_t         slot_cnt;
+  uint32_t         pid;             // of the writer
+  _Atomic int64_t  alive_ms;        // wall clock of the writers last sign of life, updated every second
+  char             pad[LT_CACHELINE - 24];
+};
+
+struct lt_value
+{
+  int32_t               value;
+  uint32_t              updates;     // values written since start, zero: no value yet
+  int64_t               updated_ms;  // wall clock (ms since epoch) of the last update
+  struct scbi_aggregate aggregate;
+};
+
+struct lt_slot
+{
+  _Atomic uint32_t      seq;
+  uint32_t              type;        // enum scbi_param_type
+  struct lt_value       val;
+  char                  bus[LT_BUS_LEN];         // CAN interface the parameter is received on
+  char                  device[LT_DEVICE_LEN];   // empty for SCBI_DEVICE_ANY
+  char                  name[LT_NAME_LEN];
+} __attribute__((aligned(LT_CACHELINE)));
+
+struct lt_writer;
+struct lt_reader;
+
+/* writer: slots for all parameters registered at the given Sorella instances, one per bus (port names the interface),
+ * the shm object is removed on close. A value is put by its bus and its index at that bus (scbi_get_param_index). */
+struct lt_writer * lt_writer_open(const char * name, struct scbi_handle ** scbi, const char ** port, size_t cnt);
+void lt_writer_put(struct lt_writer * w, size_t bus, int idx, const struct scbi_param * param, int64_t now_ms);
+void lt_writer_alive(struct lt_writer * w, int64_t now_ms);
+void lt_writer_close(struct lt_writer * w);
+
+/* reader: the mapping stays valid after the writer is gone, reopen to follow a restarted writer */
+struct lt_reader * lt_reader_open(const char * name);
+const struct lt_header * lt_reader_header(struct lt_reader * r);
+const struct lt_slot * lt_reader_slot(struct lt_reader * r, size_t idx);
+int  lt_reader_find(struct lt_reader * r, const char * bus, const char * device, const char * name);
+int  lt_reader_get(struct lt_reader * r, size_t idx, struct lt_value * val);
+void lt_reader_close(struct lt_reader * r);
+
+#endif   // _CTRL_LIVE_TABLE__H
@@ -0,0 +1,237 @@
+#include "ctrl/mqtt_link.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <mosquitto.h>
+
+#include "ctrl/logger.h"
+
+#define MQTT_LINK_BACKOFF_MIN_SEC       1
+#define MQTT_LINK_BACKOFF_MAX_SEC      60
+#define MQTT_LINK_CONNECT_TIMEOUT_SEC  10
+
+enum mqtt_link_state
+{
+  MLS_DOWN,
+  MLS_CONNECTING,
+  MLS_UP
+};
+
+struct mqtt_link
+{
+  struct mosquitto *   mosq;
+  struct mqtt_config * config;
+  enum mqtt_link_state state;
+  time_t               since;     // entered the current state, monotonic seconds
+  time_t               retry_at;  // next connection attempt while down
+  time_t               backoff;
+};
+
+
+static time_t mqtt_link_now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+static void mqtt_link_set_state(struct mqtt_link * link, enum mqtt_link_state state)
+{
+  link->state = state;
+  link->since = mqtt_link_now();
+}
+
+/* schedule the next connection attempt, the delay doubles with each failure */
+static void mqtt_link_down(struct mqtt_link * link)
+{
+  mqtt_link_set_state(link, MLS_DOWN);
+  link->retry_at = link->since + link->backoff;
+  link->backoff *= 2;
+  if (link->backoff > MQTT_LINK_BACKOFF_MAX_SEC)
+    link->backoff = MQTT_LINK_BACKOFF_MAX_SEC;
+}
+
+static void mqtt_link_on_connect(struct mosquitto * mosq, void * obj, int rc)
+{
+  struct mqtt_link * link = obj;
+
+  (void) mosq;
+  if (rc != 0)
+  {
+    LG_WARN("MQTT - Connection refused by %s:%d: %s.", link->config->remote_address, link->config->remote_port, mosquitto_connack_string(rc));
+    mqtt_link_down(link);
+    return;
+  }
+  LG_INFO("MQTT - Connected to %s:%d.", link->config->remote_address, link->config->remote_port);
+  mqtt_link_set_state(link, MLS_UP);
+  link->backoff = MQTT_LINK_BACKOFF_MIN_SEC;
+}
+
+static void mqtt_link_on_disconnect(struct mosquitto * mosq, void * obj, int rc)
+{
+  struct mqtt_link * link = obj;
+
+  (void) mosq;
+  if (link->state != MLS_DOWN)
+  {
+    if (rc != 0)
+      LG_WARN("MQTT - Connection to %s:%d lost.", link->config->remote_address, link->config->remote_port);
+    mqtt_link_down(link);
+  }
+}
+
+
+struct mqtt_link * mqtt_link_create(struct mqtt_config * config)
+{
+  struct mqtt_link * link = calloc (1, sizeof(struct mqtt_link));
+
+  if (link == NULL)
+  {
+    LG_CRITICAL("MQTT - Could not allocate link ressources.");
+    return NULL;
+  }
+  mosquitto_lib_init();
+  link->config = config;
+  link->mosq = mosquitto_new(config->client_id, true, link);
+  if (link->mosq == NULL)
+  {
+    LG_CRITICAL("MQTT - Could not create mosquitto instance. Error: %s", strerror(errno));
+    mqtt_link_destroy(link);
+    return NULL;
+  }
+  mosquitto_username_pw_set(link->mosq, config->client_id, NULL);
+  mosquitto_connect_callback_set(link->mosq, mqtt_link_on_connect);
+  mosquitto_disconnect_callback_set(link->mosq, mqtt_link_on_disconnect);
+  link->backoff = MQTT_LINK_BACKOFF_MIN_SEC;
+  mqtt_link_set_state(link, MLS_DOWN);
+  return link;
+}
+
+/* start a connection attempt without waiting for the broker, the handshake completes within the event loop.
+ * On failure the next attempt is scheduled by mqtt_link_misc.
+ */
+int mqtt_link_connect(struct mqtt_link * link)
+{
+  int rc = mosquitto_connect_async(link->mosq, link->config->remote_address, link->config->remote_port, MQTT_LINK_KEEPALIVE_SEC);
+
+  if (rc != MOSQ_ERR_SUCCESS)
+  {
+    LG_WARN("MQTT - Could not connect to %s:%d: %s. Retry in %lds.", link->config->remote_address, link->config->remote_port,
+            rc == MOSQ_ERR_ERRNO ? strerror(errno) : mosquitto_strerror(rc), (long) link->backoff);
+    mqtt_link_down(link);
+    return -1;
+  }
+  mqtt_link_set_state(link, MLS_CONNECTING);
+  return 0;
+}
+
+int mqtt_link_connected(struct mqtt_link * link)
+{
+  return link->state == MLS_UP;
+}
+
+int mqtt_link_socket(struct mqtt_link * link)
+{
+  return mosquitto_socket(link->mosq);
+}
+
+int mqtt_link_want_write(struct mqtt_link * link)
+{
+  return mosquitto_want_write(link->mosq);
+}
+
+static int mqtt_link_check(struct mqtt_link * link, int rc, const char * op)
+{
+  if (rc == MOSQ_ERR_SUCCESS || rc == MOSQ_ERR_NO_CONN)
+    return 0;
+  if (link->state != MLS_DOWN)
+  {
+    LG_WARN("MQTT - %s failed: %s. Reconnecting in %lds.", op, rc == MOSQ_ERR_ERRNO ? strerror(errno) : mosquitto_strerror(rc), (long) link->backoff);
+    mqtt_link_down(link);
+  }
+  return -1;
+}
+
+int mqtt_link_read(struct mqtt_link * link)
+{
+  return mqtt_link_check(link, mosquitto_loop_read(link->mosq, 1), "Read");
+}
+
+int mqtt_link_write(struct mqtt_link * link)
+{
+  return mqtt_link_check(link, mosquitto_loop_write(link->mosq, 1), "Write");
+}
+
+/* periodic housekeeping: keepalive while up, connection timeout and reconnect with backoff otherwise */
+int mqtt_link_misc(struct mqtt_link * link)
+{
+  time_t now = mqtt_link_now();
+
+  switch (link->state)
+  {
+    case MLS_UP:
+      return mqtt_link_check(link, mosquitto_loop_misc(link->mosq), "Housekeeping");
+    case MLS_CONNECTING:
+      if (now - link->since < MQTT_LINK_CONNECT_TIMEOUT_SEC)
+        return 0;
+      LG_WARN("MQTT - Connecting to %s:%d timed out. Retry in %lds.", link->config->remote_address, link->config->remote_port, (long) link->backoff);
+      mqtt_link_down(link);
+      mosquitto_disconnect(link->mosq);
+      return -1;
+    case MLS_DOWN:
+      if (now < link->retry_at)
+        return 0;
+      return mqtt_link_connect(link);
+  }
+  return 0;
+}
+
+/* <topic>[/<bus>][/<device>]/<type>[/<name>] */
+int mqtt_link_topic(struct mqtt_link * link, char * topic, size_t size, const char * bus, const char * device, const char * type, const char * name)
+{
+  int len = snprintf(topic, size, "%s", link->config->topic);
+
+  if (bus)
+    len += snprintf(topic + len, size > (size_t) len ? size - len : 0, "/%s", bus);
+  if (device)
+    len += snprintf(topic + len, size > (size_t) len ? size - len : 0, "/%s", device);
+  len += snprintf(topic + len, size > (size_t) len ? size - len : 0, "/%s", type);
+  if (name)
+    len += snprintf(topic + len, size > (size_t) len ? size - len : 0, "/%s", name);
+  return (size_t) len < size ? len : -1;
+}
+
+int mqtt_link_send(struct mqtt_link * link, const char * topic, const void * payload, int len)
+{
+  int rc;
+
+  if (link->state != MLS_UP)
+    return -1;
+  rc = mosquitto_publish(link->mosq, NULL, topic, len, payload, link->config->qos, false);
+  if (rc != MOSQ_ERR_SUCCESS)
+  {
+    LG_ERROR("MQTT - Could not publish %s.", topic);
+    mqtt_link_check(link, rc, "Publish");
+    return -1;
+  }
+  return 0;
+}
+
+void mqtt_link_destroy(struct mqtt_link * link)
+{
+  if (link)
+  {
+    if (link->mosq)
+    {
+      link->state = MLS_DOWN;
+      mosquitto_disconnect(link->mosq);
+      mosquitto_destroy(link->mosq);
+    }
+    mosquitto_lib_cleanup();
+    free(link);
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef _CTRL_MQTT_LINK__H
+#define _CTRL_MQTT_LINK__H
+
+#include <stddef.h>
+
+#include "ctrl/com/mqtt.h"
+
+/* thin libmosquitto wrapper exposing the broker socket so the glue layer
+ * can drive the MQTT protocol from its own event loop. Connecting doesn't wait for
+ * the broker, a lost or refused connection is retried with backoff by mqtt_link_misc.
+ */
+
+#define MQTT_LINK_KEEPALIVE_SEC 60
+#define MQTT_LINK_TOPIC_LEN    256
+
+struct mqtt_link;
+
+struct mqtt_link * mqtt_link_create(struct mqtt_config * config);
+int  mqtt_link_connect(struct mqtt_link * link);
+int  mqtt_link_connected(struct mqtt_link * link);
+int  mqtt_link_socket(struct mqtt_link * link);
+int  mqtt_link_want_write(struct mqtt_link * link);
+int  mqtt_link_read(struct mqtt_link * link);
+int  mqtt_link_write(struct mqtt_link * link);
+int  mqtt_link_misc(struct mqtt_link * link);
+int  mqtt_link_topic(struct mqtt_link * link, char * topic, size_t size, const char * bus, const char * device, const char * type, const char * name);
+int  mqtt_link_send(struct mqtt_link * link, const char * topic, const void * payload, int len);
+void mqtt_link_destroy(struct mqtt_link * link);
+
+#endif   // _CTRL_MQTT_LINK__H
@@ -5,13 +5,32 @@ struct scbi_param_internal
     struct scbi_param public;
     scbi_time         last_tx;
     uint32_t          in_queue;
+    uint32_t          key;
+    struct scbi_deadband band;
+    uint8_t           prio;       /* enum scbi_priority */
+    int8_t            trend;      /* direction of the last published change */
+    uint8_t           has_value;  /* a value was published since registration */
+    struct scbi_param_stats stats;
+    struct                        /* running aggregation of the current window */
+    {
+      uint32_t        window_ms;  /* zero: no aggregation */
+      scbi_time       start;
+      uint32_t        count;
+      int32_t         min;
+      int32_t         max;
+      int32_t         last;
+      int64_t         sum;
+    } agg;
 };
 
+/* registered parameters are stored contiguously, looked up by an open addressed hash over their key */
 struct scbi_params
 {
-    struct scbi_param_internal sensor [DST_COUNT][SCBI_MAX_SENSORS];
-    struct scbi_param_internal relay [DRM_COUNT][DRE_COUNT][SCBI_MAX_RELAYS];
-    struct scbi_param_internal oview [DOT_COUNT][DOM_COUNT];
+    struct scbi_param_internal * entry;
+    uint16_t *                   slot;    /* entry index + 1, zero marks an empty slot */
+    uint32_t                     cnt;
+    uint32_t                     cap;
+    uint32_t                     slot_bits;
 };
 
 struct scbi_param_queue_entry
@@ -20,54 +39,106 @@ struct scbi_param_queue_entry
   struct scbi_param_queue_entry * next;
 };
 
-#define SCBI_PARAM_MAX_ENTRIES (sizeof(struct scbi_params) / sizeof(struct scbi_param_internal))
+/* meters the output of a priority class, tokens are counted in thousandths */
+struct scbi_token_bucket
+{
+  uint32_t  rate;       /* tokens per second, zero: unlimited */
+  uint32_t  burst;
+  uint64_t  tokens;
+  scbi_time last;
+};
 
+/* a FIFO per priority class, all of them share the entry pool */
 struct scbi_param_queue {
-  struct scbi_param_queue_entry * first;
-  struct scbi_param_queue_entry * last;
+  struct
+  {
+    struct scbi_param_queue_entry * first;
+    struct scbi_param_queue_entry * last;
+    struct scbi_token_bucket        bucket;
+  } cls[SCBI_PRIO_CNT];
   struct scbi_param_queue_entry * free;
-  struct scbi_param_queue_entry pool[SCBI_PARAM_MAX_ENTRIES];
+  struct scbi_param_queue_entry * pool;
 };
 
 
+struct scbi_bulk_slot   /* reassembly state of one bulk transfer */
+{
+  uint32_t                key;          /* CAN id sans protocol/flags */
+  uint8_t                 in_use;
+  uint8_t                 next_seq;
+  uint16_t                expected;
+  uint16_t                len;
+  scbi_time               last_rx;
+  uint8_t                 data[SCBI_BULK_MAX_LEN];
+};
+
+struct scbi_ctr_entry    /* presence of a controller seen on the bus */
+{
+  uint8_t                 client;
+  uint8_t                 device_id;
+  uint8_t                 oem_id;
+  uint8_t                 variant;
+  uint8_t                 alive;
+  scbi_time               first_seen;
+  scbi_time               last_seen;
+  uint32_t                resets;
+};
+
+#define BYTE_FORMAT_PRINT_LEN 3        // 2 hex digits + 1 whitespace
+#define BYTE_FORMAT_COUNT CAN_MAX_DLEN // max amount of bytes in resulting formatted string
+
 struct scbi_handle {
   log_push_fn             log_push;
+  enum scbi_log_level     log_level;
   uint32_t                repost_timeout_s;
   scbi_time               now;
+  struct scbi_stats       stats;
+  scbi_event_fn           event_fn;
+  void *                  event_ctx;
   struct scbi_params      param;
   struct scbi_param_queue queue;
+  struct scbi_bulk_slot   bulk[SCBI_BULK_SLOTS];
+  uint8_t                 client_dev[UINT8_MAX + 1];       /* CAN client id -> device, zero routes to SCBI_DEVICE_ANY */
+  const char *            dev_name[SCBI_MAX_DEVICES + 1];
+  uint8_t                 dev_cnt;
+  uint8_t                 client_ctr[UINT8_MAX + 1];       /* CAN client id -> presence table entry + 1 */
+  struct scbi_ctr_entry   ctr[SCBI_MAX_CONTROLLERS];
+  uint8_t                 ctr_cnt;
+  scbi_time               checked;                         /* last housekeeping */
+  char                    xf[BYTE_FORMAT_COUNT * BYTE_FORMAT_PRINT_LEN + 1];  /* per instance, instances may run in parallel threads */
 };
 
 #define BYTE2TEMP(x) ((uint8_t) (((uint16_t) (x) * 100) / 255))
 #define TEMP2BYTE(x) ((unit8_t) (((uint16_t) (x) * 255) / 100))
 
-#define LG_DEBUG(FORMAT, ...) if (hnd->log_push) hnd->log_push(SCBI_LL_DEBUG, FORMAT, ##__VA_ARGS__)
-#define LG_INFO(FORMAT, ... ) if (hnd->log_push) hnd->log_push(SCBI_LL_INFO, FORMAT, ##__VA_ARGS__)
-#define LG_WARN(FORMAT, ...) if (hnd->log_push) hnd->log_push(SCBI_LL_WARN, FORMAT, ##__VA_ARGS__)
-#define LG_ERROR(FORMAT, ...) if (hnd->log_push) hnd->log_push(SCBI_LL_ERROR, FORMAT, ##__VA_ARGS__)
-#define LG_CRITICAL(FORMAT, ...) if (hnd->log_push) hnd->log_push(SCBI_LL_CRITICAL, FORMAT, ##__VA_ARGS__)
+/* log statements are gated before their arguments get evaluated - at build time by SCBI_LOG_MIN_LEVEL, at runtime by the handles level */
+#define LG_ENABLED(LL) ((LL) <= SCBI_LOG_MIN_LEVEL && (LL) <= hnd->log_level && hnd->log_push)
 
+#define LG_PUSH(LL, FORMAT, ...) if (LG_ENABLED(LL)) hnd->log_push(LL, FORMAT, ##__VA_ARGS__)
+#define LG_DEBUG(FORMAT, ...) LG_PUSH(SCBI_LL_DEBUG, FORMAT, ##__VA_ARGS__)
+#define LG_INFO(FORMAT, ... ) LG_PUSH(SCBI_LL_INFO, FORMAT, ##__VA_ARGS__)
+#define LG_WARN(FORMAT, ...) LG_PUSH(SCBI_LL_WARNING, FORMAT, ##__VA_ARGS__)
+#define LG_ERROR(FORMAT, ...) LG_PUSH(SCBI_LL_ERROR, FORMAT, ##__VA_ARGS__)
+#define LG_CRITICAL(FORMAT, ...) LG_PUSH(SCBI_LL_CRITICAL, FORMAT, ##__VA_ARGS__)
 
-/* global helper fcts */
 
-#define BYTE_FORMAT_PRINT_LEN 3        // 2 hex digits + 1 whitespace
-#define BYTE_FORMAT_COUNT CAN_MAX_DLEN // max amount of bytes in resulting formatted string
+/* global helper fcts */
 
 
 /* print uint8_t data in hex */
-static const char * format_scbi_frame_data (const struct scbi_frame * frame)
+static const char * format_scbi_data (struct scbi_handle * hnd, const uint8_t * data, size_t len)
 {
   static const char hexmap[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-  static char xf[BYTE_FORMAT_COUNT * BYTE_FORMAT_PRINT_LEN + 1] = "";
-  int cnt = frame->msg.len;
+  char * xf = hnd->xf;
+  int cnt = len;
 
   if (cnt > BYTE_FORMAT_COUNT)
     cnt = BYTE_FORMAT_COUNT;
 
   for (int i = 0; i < cnt; i++)
   {
-    xf[i * 3 + 0] = hexmap[(frame->msg.data[i] >> 4)];
-    xf[i * 3 + 1] = hexmap[(frame->msg.data[i] & 0x0F)];
+    xf[i * 3 + 0] = hexmap[(data[i] >> 4)];
+    xf[i * 3 + 1] = hexmap[(data[i] & 0x0F)];
     xf[i * 3 + 2] = ' ';
   }
   if (cnt)
@@ -79,7 +150,7 @@ static const char * format_scbi_frame_data (const struct scbi_frame * frame)
 
 static inline scbi_time scbi_time_diff(scbi_time sooner, scbi_time later)
 {
-  if (later > sooner)
+  if (later >= sooner)
     return later - sooner;
   else
     return later + (SCBI_TIME_MAX - sooner);
@@ -97,76 +168,200 @@ static inline scbi_time scbi_time_diff(scbi_time sooner, scbi_time later)
 
 /* helper fcts */
 
+#define SCBI_PARAM_MAX_CAP UINT16_MAX   /* limited by the hash slots index type */
+
+static inline uint32_t param_key(uint8_t dev, enum scbi_param_type type, uint8_t a, uint8_t b, uint8_t c)
+{
+  return ((uint32_t) dev << 28) | ((uint32_t) (type & 0x0F) << 24) | ((uint32_t) a << 16) | ((uint32_t) b << 8) | c;
+}
+
+static inline uint32_t param_hash(struct scbi_handle * hnd, uint32_t key)
+{
+  return (key * 2654435761U) >> (32 - hnd->param.slot_bits);   /* fibonacci hashing */
+}
+
+static inline struct scbi_param_internal * find_param(struct scbi_handle * hnd, uint32_t key)
+{
+  uint32_t mask = (1U << hnd->param.slot_bits) - 1;
+
+  for (uint32_t i = param_hash(hnd, key); hnd->param.slot[i]; i = (i + 1) & mask)
+  {
+    struct scbi_param_internal * param = &hnd->param.entry[hnd->param.slot[i] - 1];
+    if (param->key == key)
+      return param;
+  }
+  return NULL;
+}
+
+static int register_param(struct scbi_handle * hnd, size_t dev, enum scbi_param_type type, uint32_t key, const char * entity)
+{
+  struct scbi_param_internal * param = find_param(hnd, key);
+
+  if (param == NULL)
+  {
+    uint32_t mask = (1U << hnd->param.slot_bits) - 1;
+    uint32_t i;
+
+    if (entity == NULL)
+      return 0;
+    if (hnd->param.cnt >= hnd->param.cap)
+    {
+      LG_ERROR("Parameter capacity (%u) exhausted, can't register '%s'.", hnd->param.cap, entity);
+      return -1;
+    }
+    for (i = param_hash(hnd, key); hnd->param.slot[i]; i = (i + 1) & mask);
+    param = &hnd->param.entry[hnd->param.cnt++];
+    param->key = key;
+    hnd->param.slot[i] = hnd->param.cnt;
+  }
+  param->public.name   = entity;
+  param->public.value  = INT32_MAX;
+  param->prio          = type == SCBI_PARAM_TYPE_RELAY ? SCBI_PRIO_HIGH : type == SCBI_PARAM_TYPE_OVERVIEW ? SCBI_PRIO_LOW : SCBI_PRIO_NORMAL;
+  param->has_value     = 0;
+  param->trend         = 0;
+  param->agg.count     = 0;
+  param->public.aggregate.count = 0;
+  param->public.type   = type;
+  param->public.device = hnd->dev_name[dev];
+  return 0;
+}
+
 static int push_param(struct scbi_handle * hnd, struct scbi_param_internal * param)
 {
   if (param->in_queue)
     return 0;
   if (hnd->queue.free == NULL)
+  {
+    hnd->stats.queue_full++;
     return -1;
+  }
 
   struct scbi_param_queue_entry * quentry = hnd->queue.free;
   hnd->queue.free = quentry->next;
   quentry->next = NULL;
   quentry->param = param;
-  if (hnd->queue.last)
-    hnd->queue.last->next = quentry;
+  if (hnd->queue.cls[param->prio].last)
+    hnd->queue.cls[param->prio].last->next = quentry;
   else
-    hnd->queue.first = quentry;
-  hnd->queue.last = quentry;
+    hnd->queue.cls[param->prio].first = quentry;
+  hnd->queue.cls[param->prio].last = quentry;
   param->in_queue = 1;
   return 0;
 }
 
-static inline int update_param(struct scbi_handle * hnd, scbi_time recvd, struct scbi_param_internal * param, int32_t value)
+/* a value is worth publishing if it leaves the band around the last published one,
+ * turning back against the last change additionally has to overcome the hysteresis
+ */
+static inline int leaves_band(const struct scbi_param_internal * param, int32_t value)
 {
-  if (param->public.name && (param->public.value != value || scbi_time_diff(param->last_tx, recvd) > hnd->repost_timeout_s * 1000))
+  int64_t delta = (int64_t) value - param->public.value;
+  int64_t last  = param->public.value;
+  int64_t band  = param->band.absolute;
+
+  if (param->band.relative)
   {
-    param->public.value = value;
-    param->last_tx = recvd;
-    return push_param(hnd, param);
+    int64_t rel = (last < 0 ? -last : last) * param->band.relative / 1000;
+    if (rel > band)
+      band = rel;
   }
-  return 0;
+  if (param->trend && (delta < 0) != (param->trend < 0))
+    band += param->band.hysteresis;
+  return (delta < 0 ? -delta : delta) > band;
 }
 
-static inline int update_sensor(struct scbi_handle * hnd, scbi_time recvd, enum scbi_dlg_sensor_type type, size_t id, int32_t value)
+static inline int window_expired(const struct scbi_param_internal * param, scbi_time now)
 {
-  if (type >= DST_COUNT)
-    return -1;
-  if (id >= SCBI_MAX_SENSORS)
-    return 0;
-  return update_param(hnd, recvd, &hnd->param.sensor[type][id], value);
+  return param->agg.count && scbi_time_diff(param->agg.start, now) >= param->agg.window_ms;
 }
 
-static inline int update_relay(struct scbi_handle * hnd, scbi_time recvd, enum scbi_dlg_relay_mode mode, enum scbi_dlg_relay_ext_func efct, size_t id, int32_t value)
+/* publish the statistics of the current window and start over */
+static int close_window(struct scbi_handle * hnd, struct scbi_param_internal * param, scbi_time now)
 {
-  if (efct == DRE_DISABLED || efct == DRE_UNSELECTED) /* last two extfuncts (0xFE & 0XFF) are wrapped to the end of the map */
-    efct -= DRE_DISABLED - (DRE_COUNT - 2);
-  if (mode >= DRM_COUNT || efct >= DRE_COUNT)
-    return -1;
-  if (id >= SCBI_MAX_RELAYS)
-    return 0;
-  if (mode == DRM_RELAYMODE_SWITCHED && value > 100) /* we limit relay output to 100 in order to use it as percentage value. (PWM flushing is represented raw as 0xFF)*/
-    value = 100;
-  return update_param(hnd, recvd, &hnd->param.relay[mode][efct][id], value);
+  int64_t sum = param->agg.sum, cnt = param->agg.count;
+
+  param->public.value           = param->agg.last;
+  param->public.aggregate.min   = param->agg.min;
+  param->public.aggregate.max   = param->agg.max;
+  param->public.aggregate.mean  = (sum < 0 ? sum - cnt / 2 : sum + cnt / 2) / cnt;
+  param->public.aggregate.count = param->agg.count;
+  param->agg.count = 0;
+  param->last_tx   = now;
+  param->stats.published++;
+  return push_param(hnd, param);
 }
 
-static inline int update_overview(struct scbi_handle * hnd, scbi_time recvd, enum scbi_dlg_overview_type type, enum scbi_dlg_overview_mode mode, int value)
+/* fold a value into the current window, a value beyond the windows end closes it first and queues its aggregate */
+static inline int aggregate_param(struct scbi_handle * hnd, scbi_time recvd, struct scbi_param_internal * param, int32_t value)
 {
-  if (type >= DOT_COUNT || mode > DOM_COUNT)
-    return -1;
-  return update_param(hnd, recvd, &hnd->param.oview[type][mode], value);
+  int ret = 0;
+
+  if (window_expired(param, recvd))
+    ret = close_window(hnd, param, recvd);
+  else if (param->agg.count)
+    param->stats.suppressed++;
+
+  if (param->agg.count == 0)
+  {
+    param->agg.start = recvd;
+    param->agg.min   = param->agg.max = value;
+    param->agg.sum   = 0;
+  }
+  if (value < param->agg.min)
+    param->agg.min = value;
+  if (value > param->agg.max)
+    param->agg.max = value;
+  param->agg.sum += value;
+  param->agg.last = value;
+  param->agg.count++;
+  return ret;
 }
 
+static inline int update_param(struct scbi_handle * hnd, scbi_time recvd, struct scbi_param_internal * param, int32_t value)
+{
+  if (param == NULL || param->public.name == NULL)
+  {
+    hnd->stats.frames_unregistered++;
+    return 0;
+  }
+  param->stats.received++;
+  if (param->agg.window_ms)
+    return aggregate_param(hnd, recvd, param, value);
+  if (param->has_value && !leaves_band(param, value))
+  {
+    if (scbi_time_diff(param->last_tx, recvd) <= hnd->repost_timeout_s * 1000)
+    {
+      param->stats.suppressed++;
+      return 0;
+    }
+    param->stats.reposts++;
+  }
+  param->stats.published++;
+  if (param->has_value && value != param->public.value)
+    param->trend = value > param->public.value ? 1 : -1;
+  param->has_value    = 1;
+  param->public.value = value;
+  param->last_tx = recvd;
+  return push_param(hnd, param);
+}
+
+static inline int is_valid_relay(enum scbi_dlg_relay_mode mode, enum scbi_dlg_relay_ext_func efct)
+{
+  return mode < DRM_COUNT && (efct <= DRE_CASCADE || efct == DRE_DISABLED || efct == DRE_UNSELECTED);
+}
 
 static void init_queue(struct scbi_handle * hnd) {
-  for (int i = 0; i < SCBI_PARAM_MAX_ENTRIES - 1; i++) {
-    hnd->queue.pool[i].next = &hnd->queue.pool[i + 1];
-    if (hnd->queue.pool[i].param) {
-      hnd->queue.pool[i].param->in_queue = 0;
-      hnd->queue.pool[i].param = NULL;
-    }
+  for (uint32_t i = 0; i < hnd->param.cnt; i++)
+    hnd->param.entry[i].in_queue = 0;
+  for (uint32_t i = 0; i < hnd->param.cap; i++) {
+    hnd->queue.pool[i].next  = i + 1 < hnd->param.cap ? &hnd->queue.pool[i + 1] : NULL;
+    hnd->queue.pool[i].param = NULL;
+  }
+  hnd->queue.free  = hnd->param.cap ? &hnd->queue.pool[0] : NULL;
+  for (int c = 0; c < SCBI_PRIO_CNT; c++)
+  {
+    hnd->queue.cls[c].first = NULL;
+    hnd->queue.cls[c].last  = NULL;
   }
-  hnd->queue.free = &hnd->queue.pool[0];
 }
 
 
@@ -174,68 +369,306 @@ static void init_queue(struct scbi_handle * hnd) {
 
 /* public functions */
 
-struct scbi_handle * scbi_init(alloc_fn alloc, log_push_fn log_push, uint32_t repost_timeout_s)
+struct scbi_handle * scbi_init_ex(alloc_fn alloc, log_push_fn log_push, enum scbi_log_level log_level, uint32_t repost_timeout_s, size_t max_params)
 {
-  struct scbi_handle * hnd = alloc(sizeof(struct scbi_handle));
+  struct scbi_handle * hnd;
+  uint32_t slot_bits = 1;
+  size_t   size;
+
+  if (max_params > SCBI_PARAM_MAX_CAP)
+    return NULL;
+  while ((1U << slot_bits) < 2 * max_params)   /* keep the hash at most half full */
+    slot_bits++;
+
+  /* handle, parameter table, queue pool and hash slots share one allocation - ordered by alignment needs */
+  size = sizeof(struct scbi_handle) + max_params * (sizeof(struct scbi_param_internal) + sizeof(struct scbi_param_queue_entry))
+       + (1U << slot_bits) * sizeof(uint16_t);
+  hnd = alloc(size);
   if (hnd)
   {
-    for (int i = 0; i < sizeof(struct scbi_handle); i++)
+    for (size_t i = 0; i < size; i++)
       ((uint8_t *) hnd)[i] = 0;
+    hnd->param.entry     = (struct scbi_param_internal *) (hnd + 1);
+    hnd->queue.pool      = (struct scbi_param_queue_entry *) (hnd->param.entry + max_params);
+    hnd->param.slot      = (uint16_t *) (hnd->queue.pool + max_params);
+    hnd->param.cap       = max_params;
+    hnd->param.slot_bits = slot_bits;
     init_queue(hnd);
     hnd->log_push = log_push;
+    hnd->log_level = log_level;
     hnd->repost_timeout_s = repost_timeout_s;
   }
   return hnd;
 }
 
-int scbi_register_sensor(struct scbi_handle * hnd, size_t id, enum scbi_dlg_sensor_type type, const char * entity)
+struct scbi_handle * scbi_init(alloc_fn alloc, log_push_fn log_push, enum scbi_log_level log_level, uint32_t repost_timeout_s)
+{
+  return scbi_init_ex(alloc, log_push, log_level, repost_timeout_s, SCBI_DEFAULT_MAX_PARAMS);
+}
+
+int scbi_register_device(struct scbi_handle * hnd, uint8_t client, const char * name)
+{
+  if (hnd->client_dev[client])
+  {
+    hnd->dev_name[hnd->client_dev[client]] = name;
+    return hnd->client_dev[client];
+  }
+  if (hnd->dev_cnt >= SCBI_MAX_DEVICES)
+  {
+    LG_ERROR("Device capacity (%u) exhausted, can't register '%s'.", SCBI_MAX_DEVICES, name);
+    return -1;
+  }
+  hnd->client_dev[client] = ++hnd->dev_cnt;
+  hnd->dev_name[hnd->dev_cnt] = name;
+  return hnd->dev_cnt;
+}
+
+int scbi_register_sensor(struct scbi_handle * hnd, size_t dev, size_t id, enum scbi_dlg_sensor_type type, const char * entity)
 {
-  if (id >= SCBI_MAX_SENSORS)
+  if (dev > hnd->dev_cnt || id > UINT8_MAX)
     return -1;
   if (type >= DST_COUNT)
     type = DST_UNKNOWN;
-  hnd->param.sensor[type][id].public.name  = entity;
-  hnd->param.sensor[type][id].public.value = INT32_MAX;
-  hnd->param.sensor[type][id].public.type  = SCBI_PARAM_TYPE_SENSOR;
+  return register_param(hnd, dev, SCBI_PARAM_TYPE_SENSOR, param_key(dev, SCBI_PARAM_TYPE_SENSOR, type, 0, id), entity);
+}
+
+int scbi_register_relay(struct scbi_handle * hnd, size_t dev, size_t id, enum scbi_dlg_relay_mode mode, enum scbi_dlg_relay_ext_func efct, const char * entity)
+{
+  if (dev > hnd->dev_cnt || !is_valid_relay(mode, efct) || id > UINT8_MAX)
+    return -1;
+  return register_param(hnd, dev, SCBI_PARAM_TYPE_RELAY, param_key(dev, SCBI_PARAM_TYPE_RELAY, mode, efct, id), entity);
+}
+
+int scbi_register_overview(struct scbi_handle * hnd, size_t dev, enum scbi_dlg_overview_type type, enum scbi_dlg_overview_mode mode, const char * entity)
+{
+  if (dev > hnd->dev_cnt || type >= DOT_COUNT || mode >= DOM_COUNT)
+    return -1;
+  return register_param(hnd, dev, SCBI_PARAM_TYPE_OVERVIEW, param_key(dev, SCBI_PARAM_TYPE_OVERVIEW, type, mode, 0), entity);
+}
+
+int scbi_register_controller(struct scbi_handle * hnd, size_t dev, enum scbi_ctr_field field, const char * entity)
+{
+  if (dev > hnd->dev_cnt || field >= SCBI_CTR_FIELD_COUNT)
+    return -1;
+  return register_param(hnd, dev, SCBI_PARAM_TYPE_CONTROLLER, param_key(dev, SCBI_PARAM_TYPE_CONTROLLER, field, 0, 0), entity);
+}
+
+int scbi_register_hcc(struct scbi_handle * hnd, size_t dev, size_t circuit, enum scbi_hcc_field field, const char * entity)
+{
+  if (dev > hnd->dev_cnt || field >= SCBI_HCC_FIELD_COUNT || circuit > UINT8_MAX)
+    return -1;
+  if (field <= SCBI_HCC_HEATREQ_SOLAR)
+    circuit = 0;
+  return register_param(hnd, dev, SCBI_PARAM_TYPE_HCC, param_key(dev, SCBI_PARAM_TYPE_HCC, field, 0, circuit), entity);
+}
+
+
+static int same_name(const char * a, const char * b)
+{
+  while (*a && *a == *b)
+  {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+int scbi_set_deadband(struct scbi_handle * hnd, size_t dev, const char * entity, const struct scbi_deadband * band)
+{
+  int cnt = 0;
+
+  if (dev > hnd->dev_cnt || entity == NULL || band == NULL)
+    return -1;
+  for (uint32_t i = 0; i < hnd->param.cnt; i++)
+  {
+    struct scbi_param_internal * param = &hnd->param.entry[i];
+
+    if (param->public.name && param->key >> 28 == dev && same_name(param->public.name, entity))
+    {
+      param->band = *band;
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+int scbi_set_aggregation(struct scbi_handle * hnd, size_t dev, const char * entity, uint32_t window_s)
+{
+  int cnt = 0;
+
+  if (dev > hnd->dev_cnt || entity == NULL || window_s > SCBI_TIME_MAX / 1000)
+    return -1;
+  for (uint32_t i = 0; i < hnd->param.cnt; i++)
+  {
+    struct scbi_param_internal * param = &hnd->param.entry[i];
+
+    if (param->public.name && param->key >> 28 == dev && same_name(param->public.name, entity))
+    {
+      param->agg.window_ms = window_s * 1000;
+      param->agg.count     = 0;
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+int scbi_set_priority(struct scbi_handle * hnd, size_t dev, const char * entity, enum scbi_priority prio)
+{
+  int cnt = 0;
+
+  if (dev > hnd->dev_cnt || entity == NULL || prio >= SCBI_PRIO_CNT)
+    return -1;
+  for (uint32_t i = 0; i < hnd->param.cnt; i++)
+  {
+    struct scbi_param_internal * param = &hnd->param.entry[i];
+
+    if (param->public.name && param->key >> 28 == dev && same_name(param->public.name, entity))
+    {
+      if (param->in_queue)
+        return -1;     /* can't move between queues, only before parsing starts */
+      param->prio = prio;
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+int scbi_set_rate_limit(struct scbi_handle * hnd, enum scbi_priority prio, uint32_t rate, uint32_t burst)
+{
+  struct scbi_token_bucket * bucket;
+
+  if (prio >= SCBI_PRIO_CNT)
+    return -1;
+  bucket = &hnd->queue.cls[prio].bucket;
+  bucket->rate   = rate;
+  bucket->burst  = burst ? burst : 1;
+  bucket->tokens = (uint64_t) bucket->burst * 1000;
+  bucket->last   = hnd->now;
   return 0;
 }
 
-int scbi_register_relay(struct scbi_handle * hnd, size_t id, enum scbi_dlg_relay_mode mode, enum scbi_dlg_relay_ext_func efct, const char * entity)
+void scbi_set_event_sink(struct scbi_handle * hnd, scbi_event_fn fn, void * ctx)
+{
+  hnd->event_fn  = fn;
+  hnd->event_ctx = ctx;
+}
+
+void scbi_get_stats(struct scbi_handle * hnd, struct scbi_stats * stats)
 {
-  if (efct == DRE_DISABLED || efct == DRE_UNSELECTED)
-    efct -= DRE_DISABLED - (DRE_COUNT - 2);
-  if (mode >= DRM_COUNT || efct >= DRE_COUNT || id >= SCBI_MAX_RELAYS)
+  *stats = hnd->stats;
+}
+
+int scbi_get_param_stats(struct scbi_handle * hnd, size_t idx, const struct scbi_param ** param, struct scbi_param_stats * stats)
+{
+  if (idx >= hnd->param.cnt)
     return -1;
-  hnd->param.relay[mode][efct][id].public.name  = entity;
-  hnd->param.relay[mode][efct][id].public.value = INT32_MAX;
-  hnd->param.relay[mode][efct][id].public.type  = SCBI_PARAM_TYPE_RELAY;
+  if (param)
+    *param = &hnd->param.entry[idx].public;
+  if (stats)
+    *stats = hnd->param.entry[idx].stats;
   return 0;
 }
 
-int scbi_register_overview(struct scbi_handle * hnd, enum scbi_dlg_overview_type type, enum scbi_dlg_overview_mode mode, const char * entity)
+int scbi_get_param_index(struct scbi_handle * hnd, const struct scbi_param * param)
 {
-  if (type >= DOT_COUNT || mode >= DOM_COUNT)
+  uintptr_t ofs = (uintptr_t) param - (uintptr_t) hnd->param.entry;   /* public is the first member of an entry */
+
+  if ((uintptr_t) param < (uintptr_t) hnd->param.entry || ofs % sizeof(struct scbi_param_internal) ||
+      ofs / sizeof(struct scbi_param_internal) >= hnd->param.cnt)
+    return -1;
+  return ofs / sizeof(struct scbi_param_internal);
+}
+
+int scbi_get_controller(struct scbi_handle * hnd, size_t idx, struct scbi_controller * ctr)
+{
+  const struct scbi_ctr_entry * entry;
+
+  if (idx >= hnd->ctr_cnt)
     return -1;
-  hnd->param.oview[type][mode].public.name  = entity;
-  hnd->param.oview[type][mode].public.value = INT32_MAX;
-  hnd->param.oview[type][mode].public.type = SCBI_PARAM_TYPE_OVERVIEW;
+  entry = &hnd->ctr[idx];
+  ctr->client     = entry->client;
+  ctr->dev        = hnd->client_dev[entry->client];
+  ctr->device     = hnd->dev_name[ctr->dev];
+  ctr->device_id  = entry->device_id;
+  ctr->oem_id     = entry->oem_id;
+  ctr->variant    = entry->variant;
+  ctr->alive      = entry->alive;
+  ctr->first_seen = entry->first_seen;
+  ctr->last_seen  = entry->last_seen;
+  ctr->resets     = entry->resets;
   return 0;
 }
 
 
-static inline struct scbi_param * pop_param(struct scbi_handle * hnd)
+/* CAN id/mask helpers for kernel side frame filtering */
+
+#define SCBI_FILTER_MASK_PROG   0x000000FFU
+#define SCBI_FILTER_MASK_FUNC   0x00FF0000U
+#define SCBI_FILTER_MASK_PROT   0x06000000U   /* FORMAT_0 & FORMAT_BULK pass */
+#define SCBI_FILTER_MASK_MSG    0x18000000U
+
+static inline uint32_t scbi_filter_id(enum scbi_prog_type prog, uint8_t func, enum scbi_msg_type msg)
+{
+  return CAN_EFF_FLAG | ((uint32_t) msg << 27) | ((uint32_t) CAN_PROTO_FORMAT_0 << 24) | ((uint32_t) func << 16) | prog;
+}
+
+static int has_registered_param(struct scbi_handle * hnd, enum scbi_param_type type)
 {
-  struct scbi_param_queue_entry * ret = hnd->queue.first;
+  for (uint32_t i = 0; i < hnd->param.cnt; i++)
+  {
+    if (hnd->param.entry[i].public.name && hnd->param.entry[i].public.type == type)
+      return 1;
+  }
+  return 0;
+}
+
+static inline size_t add_filter(struct can_filter * filter, size_t max, size_t cnt, uint32_t id, uint32_t mask)
+{
+  if (cnt < max)
+  {
+    filter[cnt].can_id   = id;
+    filter[cnt].can_mask = mask;
+  }
+  return cnt + 1;
+}
+
+size_t scbi_get_can_filters(struct scbi_handle * hnd, struct can_filter * filter, size_t max)
+{
+  static const struct { enum scbi_param_type type; enum scbi_dlg_function_type func; } dlg_funcs[] = {
+    { SCBI_PARAM_TYPE_SENSOR,   DLF_SENSOR   },
+    { SCBI_PARAM_TYPE_RELAY,    DLF_RELAY    },
+    { SCBI_PARAM_TYPE_OVERVIEW, DLG_OVERVIEW },
+  };
+  const uint32_t prog_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | SCBI_FILTER_MASK_PROG;
+  const uint32_t func_mask = prog_mask | SCBI_FILTER_MASK_FUNC | SCBI_FILTER_MASK_PROT | SCBI_FILTER_MASK_MSG;
+  size_t cnt = 0;
+
+  /* datalogger responses are only of interest if they carry a registered parameter or an event sink takes them */
+  for (size_t i = 0; i < sizeof(dlg_funcs) / sizeof(dlg_funcs[0]); i++)
+  {
+    if (hnd->event_fn || has_registered_param(hnd, dlg_funcs[i].type))
+      cnt = add_filter(filter, max, cnt, scbi_filter_id(PRG_DATALOGGER_MONITOR, dlg_funcs[i].func, CAN_MSG_RESPONSE), func_mask);
+  }
+  /* controller and heating circuit msgs are evaluated regardless of registrations */
+  cnt = add_filter(filter, max, cnt, scbi_filter_id(PRG_CONTROLLER, 0, 0), prog_mask);
+  cnt = add_filter(filter, max, cnt, scbi_filter_id(PRG_HCC, 0, 0), prog_mask);
+  return cnt;
+}
+
+
+static inline struct scbi_param * pop_param(struct scbi_handle * hnd, int c)
+{
+  struct scbi_param_queue_entry * ret = hnd->queue.cls[c].first;
   if (ret == NULL)
     return NULL;
-  hnd->queue.first = hnd->queue.first->next;
-  if (hnd->queue.last == ret) {
-    if (hnd->queue.first != NULL) {
+  hnd->queue.cls[c].first = ret->next;
+  if (hnd->queue.cls[c].last == ret) {
+    if (hnd->queue.cls[c].first != NULL) {
       LG_CRITICAL("Param Queue broken, re-Init!");
       init_queue(hnd);
       return &ret->param->public;
     }
-    hnd->queue.last = NULL;
+    hnd->queue.cls[c].last = NULL;
   }
   ret->param->in_queue = 0;
   ret->next = hnd->queue.free;
@@ -243,33 +676,60 @@ static inline struct scbi_param * pop_param(struct scbi_handle * hnd)
   return &ret->param->public;
 }
 
+/* refill by the time passed since the last call (frame time), true if a token is available */
+static inline int bucket_ready(struct scbi_token_bucket * bucket, scbi_time now)
+{
+  if (bucket->rate == 0)
+    return 1;
+  bucket->tokens += (uint64_t) scbi_time_diff(bucket->last, now) * bucket->rate;
+  if (bucket->tokens > (uint64_t) bucket->burst * 1000)
+    bucket->tokens = (uint64_t) bucket->burst * 1000;
+  bucket->last = now;
+  return bucket->tokens >= 1000;
+}
+
+/* highest class with a pending parameter and a token to send it, -1 if there is none */
+static int select_class(struct scbi_handle * hnd)
+{
+  for (int c = 0; c < SCBI_PRIO_CNT; c++)
+  {
+    while (hnd->queue.cls[c].first != NULL && hnd->queue.cls[c].first->param->public.name == NULL)
+      pop_param(hnd, c);
+    if (hnd->queue.cls[c].first != NULL && bucket_ready(&hnd->queue.cls[c].bucket, hnd->now))
+      return c;
+  }
+  return -1;
+}
 
 struct scbi_param * scbi_peek_param(struct scbi_handle * hnd)
 {
-  while (hnd->queue.first != NULL && hnd->queue.first->param->public.name == NULL)
-    pop_param(hnd);
-  if (hnd->queue.first == NULL)
+  int c = select_class(hnd);
+
+  if (c < 0)
     return NULL;
-  return &hnd->queue.first->param->public;
+  return &hnd->queue.cls[c].first->param->public;
 }
 
 struct scbi_param * scbi_pop_param(struct scbi_handle * hnd)
 {
-  struct scbi_param_queue_entry * ret = hnd->queue.first;
-  while (ret != NULL && ret->param->public.name == NULL)
-    pop_param(hnd);
-  return pop_param(hnd);
+  int c = select_class(hnd);
+
+  if (c < 0)
+    return NULL;
+  if (hnd->queue.cls[c].bucket.rate)
+    hnd->queue.cls[c].bucket.tokens -= 1000;
+  return pop_param(hnd, c);
 }
 
 void scbi_print_frame (struct scbi_handle * hnd, enum scbi_log_level ll, const char * msg_type, const char * txt, struct scbi_frame * frame)
 {
-  union scbi_address_id *adid = (union scbi_address_id*) &frame->msg.can_id;
-  if (hnd->log_push) {
+  if (LG_ENABLED(ll)) {
+    struct scbi_id id = scbi_decode_id(frame->msg.can_id);
     hnd->log_push(ll, "(%s) %s: % 6ums CAN-ID 0x%08X (prg:%02X, id:%02X, func:%02X, prot:%02X, msg:%02X%s%s%s) [%u] data:%s.",
-                  msg_type, txt == NULL ? "" : txt, frame->recvd, adid->address_id,
-                  adid->scbi_id.prog, adid->scbi_id.client, adid->scbi_id.func, adid->scbi_id.prot, adid->scbi_id.msg,
-                  adid->scbi_id.flg_err ? " ERR" : " ---", adid->scbi_id.flg_eff ? "-EFF" : "----", adid->scbi_id.flg_rtr ? "-RTR" : "----",
-                  frame->msg.len, format_scbi_frame_data (frame));
+                  msg_type, txt == NULL ? "" : txt, frame->recvd, SCBI_ADDRESS_ID(frame->msg.can_id),
+                  id.prog, id.client, id.func, id.prot, id.msg,
+                  id.flg_err ? " ERR" : " ---", id.flg_eff ? "-EFF" : "----", id.flg_rtr ? "-RTR" : "----",
+                  frame->msg.len, format_scbi_data (hnd, frame->msg.data, frame->msg.len));
   }
 }
 
@@ -286,193 +746,598 @@ void scbi_print_frame (struct scbi_handle * hnd, enum scbi_log_level ll, const c
 
 /* Helper fcts. */
 
-static void scbi_parse_datalogger (struct scbi_handle * hnd, struct scbi_frame * frame)
+struct scbi_field       /* little endian bit field within a frames payload */
+{
+  uint8_t ofs;          /* first byte */
+  uint8_t bits;         /* width, zero for an absent field */
+  uint8_t shift;        /* bit offset within the first byte */
+  uint8_t sign;         /* sign extend */
+};
+
+#define FLD(OFS, BITS, SHIFT, SIGN) { OFS, BITS, SHIFT, SIGN }
+#define FLD_U8(OFS)                 FLD(OFS,  8, 0, 0)
+#define FLD_U16(OFS)                FLD(OFS, 16, 0, 0)
+#define FLD_S32(OFS)                FLD(OFS, 32, 0, 1)
+#define FLD_U32(OFS)                FLD(OFS, 32, 0, 0)
+#define FLD_NONE                    FLD(0,    0, 0, 0)
+#define FIELDS(...)                 { __VA_ARGS__ }
+
+enum scbi_msg_field     /* field usage for parameter carrying msgs, in order of param_key() */
 {
-  union scbi_address_id *adid = (union scbi_address_id*) &frame->msg.can_id;
-  union scbi_msg_content *msg = (union scbi_msg_content*) &frame->msg.data[0];
-  switch (adid->scbi_id.msg)
+  MF_KEY_A,
+  MF_KEY_B,
+  MF_KEY_C,
+  MF_VALUE,
+  MF_HOURS,             /* overview: event only */
+  MF_YIELD,
+  SCBI_MSG_FIELDS = 6
+};
+
+struct scbi_msg_desc;
+
+typedef int (* scbi_msg_fn) (struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field);
+
+struct scbi_msg_desc
+{
+  const char *         name;
+  uint8_t              min_len;
+  enum scbi_param_type type;                    /* target parameter, SCBI_PARAM_TYPE_NONE if the handler evaluates the msg */
+  enum scbi_event_type event;                   /* kind of the event passed to the event sink */
+  struct scbi_field    field[SCBI_MSG_FIELDS];
+  scbi_msg_fn          handler;                 /* msg specific validation/evaluation (optional), nonzero rejects the msg */
+};
+
+static inline int32_t get_field(const uint8_t * data, size_t len, const struct scbi_field * fld)
+{
+  uint32_t value = 0;
+  int      bytes = (fld->shift + fld->bits + 7) / 8;
+
+  for (int i = 0; i < bytes && fld->ofs + i < len; i++)   /* bytes beyond payload length read as zero */
+    value |= (uint32_t) data[fld->ofs + i] << (8 * i);
+  value >>= fld->shift;
+  if (fld->bits < 32)
   {
-    case CAN_MSG_REQUEST:
-      LG_INFO("Datalogger requests not supported yet.");
-      break;
-    case CAN_MSG_RESERVE:
-      LG_INFO("Datalogger reserve msgs not supported yet.");
-      break;
-    case CAN_MSG_RESPONSE:
+    value &= (1U << fld->bits) - 1;
+    if (fld->sign && fld->bits && (value >> (fld->bits - 1)))
+      value |= ~((1U << fld->bits) - 1);
+  }
+  return (int32_t) value;
+}
+
+
+/* controller presence */
+
+static struct scbi_ctr_entry * get_controller(struct scbi_handle * hnd, uint8_t client)
+{
+  struct scbi_ctr_entry * ctr;
+
+  if (hnd->client_ctr[client])
+    return &hnd->ctr[hnd->client_ctr[client] - 1];
+  if (hnd->ctr_cnt >= SCBI_MAX_CONTROLLERS)
+    return NULL;
+  ctr = &hnd->ctr[hnd->ctr_cnt++];
+  ctr->client     = client;
+  ctr->first_seen = hnd->now;
+  ctr->last_seen  = hnd->now;
+  hnd->client_ctr[client] = hnd->ctr_cnt;
+  return ctr;
+}
+
+static void update_controller(struct scbi_handle * hnd, const struct scbi_ctr_entry * ctr, enum scbi_ctr_field fld, int32_t value)
+{
+  struct scbi_param_internal * param = find_param(hnd, param_key(hnd->client_dev[ctr->client], SCBI_PARAM_TYPE_CONTROLLER, fld, 0, 0));
+
+  if (param && param->public.name)
+    update_param(hnd, hnd->now, param, value);
+}
+
+/* every accepted msg proves its sender alive */
+static void touch_controller(struct scbi_handle * hnd, uint8_t client)
+{
+  struct scbi_ctr_entry * ctr = get_controller(hnd, client);
+
+  if (ctr == NULL)
+    return;
+  ctr->last_seen = hnd->now;
+  if (!ctr->alive)
+  {
+    ctr->alive = 1;
+    LG_INFO("Controller 0x%02X present.", client);
+    update_controller(hnd, ctr, SCBI_CTR_ALIVE, 1);
+  }
+}
+
+static void expire_controllers(struct scbi_handle * hnd)
+{
+  for (int i = 0; i < hnd->ctr_cnt; i++)
+  {
+    struct scbi_ctr_entry * ctr = &hnd->ctr[i];
+
+    if (ctr->alive && scbi_time_diff(ctr->last_seen, hnd->now) > SCBI_CTR_TIMEOUT_MS)
     {
-      int ret;
-      switch (adid->scbi_id.func)
-      {
-        case DLF_SENSOR:
-          if (frame->msg.len <= offsetof(struct scbi_dlg_sensor_msg, type))
-            msg->dlg.sensor.type = DST_UNKNOWN;
-          ret = update_sensor(hnd, frame->recvd, msg->dlg.sensor.type, msg->dlg.sensor.id,  msg->dlg.sensor.value);
-          if (hnd->log_push)
-            hnd->log_push(ret ? SCBI_LL_ERROR : SCBI_LL_DEBUG, "SENSOR%u (%u) -> %d (%s).", msg->dlg.sensor.id, msg->dlg.sensor.type, msg->dlg.sensor.value, format_scbi_frame_data(frame));
-          break;
-        case DLF_RELAY:
-          ret = update_relay(hnd, frame->recvd, msg->dlg.relay.mode, msg->dlg.relay.exfunc[0], msg->dlg.relay.id, msg->dlg.relay.value);
-          if (hnd->log_push)
-            hnd->log_push(ret ? SCBI_LL_ERROR : SCBI_LL_DEBUG, "RELAY%u (%u/%u) -> %u (%s).", msg->dlg.relay.id, msg->dlg.relay.mode, msg->dlg.relay.exfunc[0], msg->dlg.relay.value, format_scbi_frame_data(frame));
-          break;
-        case DLG_OVERVIEW:
-          ret = update_overview(hnd, frame->recvd, msg->dlg.oview.type, msg->dlg.oview.mode, msg->dlg.relay.value);
-          if (hnd->log_push)
-            hnd->log_push(ret ? SCBI_LL_ERROR : SCBI_LL_DEBUG, "overview %u-%u -> %uh/%ukWh. - (%s)", msg->dlg.oview.type, msg->dlg.oview.mode, msg->dlg.oview.hours, msg->dlg.oview.heat_yield, format_scbi_frame_data(frame));
-
-          break;
-        case DLF_UNDEFINED:
-        case DLG_HYDRAULIC_PROGRAM:
-        case DLG_ERROR_MESSAGE:
-        case DLG_PARAM_MONITORING:
-        case DLG_STATISTIC:
-        case DLG_HYDRAULIC_CONFIG:
-          LG_INFO("Datalogger function 0x%02X not supported yet.", adid->scbi_id.func);
-          break;
-      }
-      break;
+      ctr->alive = 0;
+      LG_WARN("Controller 0x%02X silent for %u s, considered lost.", ctr->client, SCBI_CTR_TIMEOUT_MS / 1000);
+      update_controller(hnd, ctr, SCBI_CTR_ALIVE, 0);
     }
   }
 }
 
-static void scbi_parse_controller (struct scbi_handle *hnd, struct scbi_frame * frame)
+/* windows of parameters whose values stopped arriving */
+static void expire_windows(struct scbi_handle * hnd)
 {
-  union scbi_address_id *adid = (union scbi_address_id*) &frame->msg.can_id;
-  union scbi_msg_content *msg = (union scbi_msg_content*) &frame->msg.data[0];
-  switch (adid->scbi_id.msg)
+  for (uint32_t i = 0; i < hnd->param.cnt; i++)
   {
-    case CAN_MSG_REQUEST:
-      LG_INFO ("Controller requests not supported yet.");
-      break;
-    case CAN_MSG_RESERVE:
-      LG_INFO ("Controller reserve msgs not supported yet.");
-      break;
-    case CAN_MSG_RESPONSE:
-      switch (adid->scbi_id.func)
-      {
-        case CTR_HAS_ANYBODY_HERE:
-          LG_DEBUG("0x%02X asks: 'IS ANYBODY ALIVE?'", msg->identity.can_id);
-          break;
-        case CTR_I_AM_HERE:
-          LG_DEBUG("0x%02X says: 'I AM ALIVE!'", msg->identity.can_id);
-          break;
-        case CTR_I_AM_RESETED:
-          LG_DEBUG("0x%02X says: 'RESET!'", msg->identity.can_id);
-          break;
-        case CTR_GET_CONTROLLER_ID:
-        case CTR_GET_ACTIVE_PROGRAMS_LIST:
-        case CTR_ADD_PROGRAM:
-        case CTR_REMOVE_PROGRAM:
-        case CTR_GET_SYSTEM_DATE_TIME:
-        case CTR_SET_SYSTEM_DATE_TIME:
-        case CTR_DATALOGGER_TEST:
-          LG_DEBUG("Controller function %u - CAN:%u, DEV:%u, OEM:%u, Variant:%u.", adid->scbi_id.func, msg->identity.can_id,
-                   msg->identity.cfg_dev_id, msg->identity.cfg_oem_id, msg->identity.dev_variant);
-          break;
-      }
-      break;
+    struct scbi_param_internal * param = &hnd->param.entry[i];
+
+    if (param->agg.window_ms && param->public.name && window_expired(param, hnd->now))
+      close_window(hnd, param, hnd->now);
   }
 }
 
-static void scbi_parse_hcc (struct scbi_handle *hnd, struct scbi_frame * frame)
+/* about once a second, whether frames arrive or not */
+static void housekeeping(struct scbi_handle * hnd)
 {
-  union scbi_address_id *adid = (union scbi_address_id*) &frame->msg.can_id;
-  union scbi_msg_content *msg = (union scbi_msg_content*) &frame->msg.data[0];
-  char *type = adid->scbi_id.msg == CAN_MSG_REQUEST ? "REQUEST" : "RESPONSE";
+  hnd->checked = hnd->now;
+  expire_controllers(hnd);
+  expire_windows(hnd);
+}
 
-  switch (adid->scbi_id.msg)
+/* values of a restarted controller are published as soon as they arrive, regardless of deadband and repost timeout */
+static void republish_device(struct scbi_handle * hnd, uint8_t dev)
+{
+  for (uint32_t i = 0; i < hnd->param.cnt; i++)
   {
-    case CAN_MSG_REQUEST:
-      scbi_print_frame(hnd, SCBI_LL_INFO, type, "HCC request msgs not supported yet.", frame);
-      break;
-    case CAN_MSG_RESPONSE:
-      switch (adid->scbi_id.func)
-      {
-        case HCC_HEATREQUEST:
-          if (adid->scbi_id.flg_err)
-            scbi_print_frame(hnd, SCBI_LL_ERROR, type, "heat request error", frame);
-          else if (frame->msg.len != sizeof(msg->hcc.heatreq))
-            scbi_print_frame(hnd, SCBI_LL_INFO, type, "heat request with wrong data len.", frame);
-          else
-            LG_DEBUG("(%s) Heat request - Source: %s -> %u°C.", type, msg->hcc.heatreq.heatsource ? "Solar" : "Conv.", BYTE2TEMP(msg->hcc.heatreq.raw_temp));
-          break;
-        case HCC_HEATINGCIRCUIT_STATE1:
-          if (frame->msg.len < sizeof(msg->hcc.state1))
-          { // TODO find out what's behind those msgs: 0x10019F85 (prg:85, id:9F, func:01, prot:00, msg:02----EFF----) [1] data:01
-            LG_INFO("(%s) Heat circuit status 1 with wrong data len %u.", type, frame->msg.len);
-            scbi_print_frame(hnd, SCBI_LL_INFO, type, "Heat circuit status 1 with wrong data len:", frame);
-          }
-          else
-            LG_DEBUG ("(%s) Heat circuit #%u Stats 1: state:0x%02X, flow temp (set/act/storage): %u/%u/%u°C.", type, msg->hcc.state1.circuit,
-                       msg->hcc.state1.state, BYTE2TEMP(msg->hcc.state1.temp_flowset), BYTE2TEMP(msg->hcc.state1.temp_flow),
-                       BYTE2TEMP(msg->hcc.state1.temp_storage));
-          break;
-        case HCC_HEATINGCIRCUIT_STATE2:
-          LG_DEBUG ("(%s) Heat circuit #%u Stats 2: wheel:0x%02X, room temp (set/act): %u/%u°C, humidity: %u%%.", type,
-                   msg->hcc.state2.circuit, msg->hcc.state2.wheel, BYTE2TEMP(msg->hcc.state2.temp_set),
-                   BYTE2TEMP(msg->hcc.state2.temp_room), msg->hcc.state2.humidity);
-          break;
-        case HCC_HEATINGCIRCUIT_STATE3:
-          LG_DEBUG ("(%s)Heat circuit #%u Stats 3: Operation:0x%02X, dewpoint:%u°C, on reason:0x%02X, pump:0x%02X.", type, msg->hcc.state3.circuit,
-                   msg->hcc.state3.op_mode, BYTE2TEMP(msg->hcc.state3.dewpoint), msg->hcc.state3.on_reason, msg->hcc.state3.pump);
-          break;
-        case HCC_HEATINGCIRCUIT_STATE4:
-          LG_DEBUG ("(%s)Heat circuit #%u Stats 4: Operation:0x%02X, dewpoint:%u°C, on reason:0x%02X, pump:0x%02X.", type, msg->hcc.state4.circuit,
-                   BYTE2TEMP(msg->hcc.state4.temp_min), BYTE2TEMP(msg->hcc.state4.temp_max));
-          break;
-      }
-      break;
-    case CAN_MSG_RESERVE:
-      LG_INFO("HCC reserve msgs not supported yet.");
-      break;
+    struct scbi_param_internal * param = &hnd->param.entry[i];
+
+    if ((param->key >> 28) == dev && param->public.type != SCBI_PARAM_TYPE_CONTROLLER)
+      param->has_value = 0;
+  }
+}
+
+
+/* msg handlers */
+
+static int check_sensor(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  return field[MF_KEY_A] >= DST_COUNT ? -1 : 0;
+}
+
+static int check_relay(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  if (!is_valid_relay(field[MF_KEY_A], field[MF_KEY_B]))
+    return -1;
+  if (field[MF_KEY_A] == DRM_RELAYMODE_SWITCHED && field[MF_VALUE] > 100) /* we limit relay output to 100 in order to use it as percentage value. (PWM flushing is represented raw as 0xFF)*/
+    field[MF_VALUE] = 100;
+  return 0;
+}
+
+static int check_overview(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  return field[MF_KEY_A] >= DOT_COUNT || field[MF_KEY_B] >= DOM_COUNT ? -1 : 0;
+}
+
+static int log_ctr_anybody(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  LG_DEBUG("0x%02X asks: 'IS ANYBODY ALIVE?'", field[0]);
+  return 0;
+}
+
+static int eval_ctr_alive(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  struct scbi_ctr_entry * ctr = get_controller(hnd, id->client);
+
+  LG_DEBUG("0x%02X says: 'I AM ALIVE!'", field[0]);
+  if (ctr && ctr->alive)
+    update_controller(hnd, ctr, SCBI_CTR_ALIVE, 1);   /* reposted like any unchanged value */
+  return 0;
+}
+
+static int eval_ctr_reset(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  struct scbi_ctr_entry * ctr = get_controller(hnd, id->client);
+
+  LG_DEBUG("0x%02X says: 'RESET!'", field[0]);
+  if (ctr)
+  {
+    ctr->resets++;
+    LG_INFO("Controller 0x%02X reset (#%u).", id->client, ctr->resets);
+    update_controller(hnd, ctr, SCBI_CTR_RESETS, ctr->resets);
+  }
+  if (hnd->client_dev[id->client] != SCBI_DEVICE_ANY)   /* SCBI_DEVICE_ANY parameters are shared with other controllers */
+  {
+    LG_INFO("Republishing the parameters of controller 0x%02X.", id->client);
+    republish_device(hnd, hnd->client_dev[id->client]);
+  }
+  return 0;
+}
+
+static int eval_ctr_identity(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  struct scbi_ctr_entry * ctr = get_controller(hnd, id->client);
+
+  LG_DEBUG("Controller function %u - CAN:%u, DEV:%u, OEM:%u, Variant:%u.", id->func, field[0], field[1], field[2], field[3]);
+  if (ctr)
+  {
+    ctr->device_id = field[1];
+    ctr->oem_id    = field[2];
+    ctr->variant   = field[3];
+  }
+  return 0;
+}
+
+static int log_ctr_identity(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  LG_DEBUG("Controller function %u - CAN:%u, DEV:%u, OEM:%u, Variant:%u.", id->func, field[0], field[1], field[2], field[3]);
+  return 0;
+}
+
+/* heating circuit msgs carry several values each, every registered one is updated like a datalogger parameter */
+static void update_hcc(struct scbi_handle * hnd, const struct scbi_id * id, int32_t circuit, enum scbi_hcc_field fld, int32_t value)
+{
+  struct scbi_param_internal * param = find_param(hnd, param_key(hnd->client_dev[id->client], SCBI_PARAM_TYPE_HCC, fld, 0, circuit));
+
+  if (param && param->public.name)
+    update_param(hnd, hnd->now, param, value);
+}
+
+static int eval_hcc_heatreq(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  LG_DEBUG("Heat request - Source: %s -> %u°C.", field[1] ? "Solar" : "Conv.", BYTE2TEMP(field[0]));
+  update_hcc(hnd, id, 0, SCBI_HCC_HEATREQ_TEMP, BYTE2TEMP(field[0]));
+  update_hcc(hnd, id, 0, SCBI_HCC_HEATREQ_SOLAR, field[1] != 0);
+  return 0;
+}
+
+static int eval_hcc_state1(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  LG_DEBUG("Heat circuit #%u Stats 1: state:0x%02X, flow temp (set/act/storage): %u/%u/%u°C.", field[0], field[1],
+           BYTE2TEMP(field[2]), BYTE2TEMP(field[3]), BYTE2TEMP(field[4]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_STATE, field[1]);
+  update_hcc(hnd, id, field[0], SCBI_HCC_FLOW_SET, BYTE2TEMP(field[2]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_FLOW, BYTE2TEMP(field[3]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_STORAGE, BYTE2TEMP(field[4]));
+  return 0;
+}
+
+static int eval_hcc_state2(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  LG_DEBUG("Heat circuit #%u Stats 2: wheel:0x%02X, room temp (set/act): %u/%u°C, humidity: %u%%.", field[0], field[1],
+           BYTE2TEMP(field[2]), BYTE2TEMP(field[3]), field[4]);
+  update_hcc(hnd, id, field[0], SCBI_HCC_WHEEL, field[1]);
+  update_hcc(hnd, id, field[0], SCBI_HCC_ROOM_SET, BYTE2TEMP(field[2]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_ROOM, BYTE2TEMP(field[3]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_HUMIDITY, field[4]);
+  return 0;
+}
+
+static int eval_hcc_state3(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  LG_DEBUG("Heat circuit #%u Stats 3: Operation:0x%02X, dewpoint:%u°C, pump:0x%02X, on reason:0x%02X.", field[0], field[1],
+           BYTE2TEMP(field[2]), field[3], field[4]);
+  update_hcc(hnd, id, field[0], SCBI_HCC_MODE, field[1]);
+  update_hcc(hnd, id, field[0], SCBI_HCC_DEWPOINT, BYTE2TEMP(field[2]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_PUMP, field[3]);
+  update_hcc(hnd, id, field[0], SCBI_HCC_ON_REASON, field[4]);
+  return 0;
+}
+
+static int eval_hcc_state4(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, int32_t * field)
+{
+  LG_DEBUG("Heat circuit #%u Stats 4: temp (min/max): %u/%u°C.", field[0], BYTE2TEMP(field[1]), BYTE2TEMP(field[2]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_TEMP_MIN, BYTE2TEMP(field[1]));
+  update_hcc(hnd, id, field[0], SCBI_HCC_TEMP_MAX, BYTE2TEMP(field[2]));
+  return 0;
+}
+
+
+/* the supported message set - dispatch and decoding are generated from this table */
+
+#define SCBI_MSG_TABLE(X) \
+/*  ident          prog                    func                          msg               len  target parameter          event                 payload fields                                                                    handler */ \
+  X(DLG_SENSOR,    PRG_DATALOGGER_MONITOR, DLF_SENSOR,                   CAN_MSG_RESPONSE, 5,   SCBI_PARAM_TYPE_SENSOR,   SCBI_EVT_SENSOR,      FIELDS(FLD_U8(5), FLD_NONE, FLD_U8(0), FLD_S32(1)),                               check_sensor) \
+  X(DLG_RELAY,     PRG_DATALOGGER_MONITOR, DLF_RELAY,                    CAN_MSG_RESPONSE, 4,   SCBI_PARAM_TYPE_RELAY,    SCBI_EVT_RELAY,       FIELDS(FLD_U8(1), FLD_U8(3), FLD_U8(0), FLD_U8(2)),                              check_relay) \
+  X(DLG_OVERVIEW,  PRG_DATALOGGER_MONITOR, DLG_OVERVIEW,                 CAN_MSG_RESPONSE, 3,   SCBI_PARAM_TYPE_OVERVIEW, SCBI_EVT_OVERVIEW,    FIELDS(FLD(0, 3, 5, 0), FLD_U8(1), FLD_NONE, FLD_U8(2), FLD_U16(2), FLD_U32(4)),  check_overview) \
+  X(CTR_ANYBODY,   PRG_CONTROLLER,         CTR_HAS_ANYBODY_HERE,         CAN_MSG_RESPONSE, 1,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_ANYBODY, FIELDS(FLD_U8(0)),                                                                log_ctr_anybody) \
+  X(CTR_ALIVE,     PRG_CONTROLLER,         CTR_I_AM_HERE,                CAN_MSG_RESPONSE, 1,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_ALIVE,   FIELDS(FLD_U8(0)),                                                                eval_ctr_alive) \
+  X(CTR_RESET,     PRG_CONTROLLER,         CTR_I_AM_RESETED,             CAN_MSG_RESPONSE, 1,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_RESET,   FIELDS(FLD_U8(0)),                                                                eval_ctr_reset) \
+  X(CTR_CTRL_ID,   PRG_CONTROLLER,         CTR_GET_CONTROLLER_ID,        CAN_MSG_RESPONSE, 0,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_INFO,    FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3)),                              eval_ctr_identity) \
+  X(CTR_PROGRAMS,  PRG_CONTROLLER,         CTR_GET_ACTIVE_PROGRAMS_LIST, CAN_MSG_RESPONSE, 0,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_INFO,    FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3)),                              log_ctr_identity) \
+  X(CTR_ADD_PRG,   PRG_CONTROLLER,         CTR_ADD_PROGRAM,              CAN_MSG_RESPONSE, 0,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_INFO,    FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3)),                              log_ctr_identity) \
+  X(CTR_RM_PRG,    PRG_CONTROLLER,         CTR_REMOVE_PROGRAM,           CAN_MSG_RESPONSE, 0,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_INFO,    FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3)),                              log_ctr_identity) \
+  X(CTR_GET_TIME,  PRG_CONTROLLER,         CTR_GET_SYSTEM_DATE_TIME,     CAN_MSG_RESPONSE, 0,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_INFO,    FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3)),                              log_ctr_identity) \
+  X(CTR_SET_TIME,  PRG_CONTROLLER,         CTR_SET_SYSTEM_DATE_TIME,     CAN_MSG_RESPONSE, 0,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_INFO,    FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3)),                              log_ctr_identity) \
+  X(CTR_DLG_TEST,  PRG_CONTROLLER,         CTR_DATALOGGER_TEST,          CAN_MSG_RESPONSE, 0,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_CTR_INFO,    FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3)),                              log_ctr_identity) \
+  X(HCC_HEATREQ,   PRG_HCC,                HCC_HEATREQUEST,              CAN_MSG_RESPONSE, 2,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_HCC_HEATREQ, FIELDS(FLD_U8(0), FLD_U8(1)),                                                     eval_hcc_heatreq) \
+  X(HCC_STATE1,    PRG_HCC,                HCC_HEATINGCIRCUIT_STATE1,    CAN_MSG_RESPONSE, 5,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_HCC_STATE1,  FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3), FLD_U8(4)),                   eval_hcc_state1) \
+  X(HCC_STATE2,    PRG_HCC,                HCC_HEATINGCIRCUIT_STATE2,    CAN_MSG_RESPONSE, 5,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_HCC_STATE2,  FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3), FLD_U8(4)),                   eval_hcc_state2) \
+  X(HCC_STATE3,    PRG_HCC,                HCC_HEATINGCIRCUIT_STATE3,    CAN_MSG_RESPONSE, 5,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_HCC_STATE3,  FIELDS(FLD_U8(0), FLD_U8(1), FLD_U8(2), FLD_U8(3), FLD_U8(4)),                   eval_hcc_state3) \
+  X(HCC_STATE4,    PRG_HCC,                HCC_HEATINGCIRCUIT_STATE4,    CAN_MSG_RESPONSE, 6,   SCBI_PARAM_TYPE_NONE,     SCBI_EVT_HCC_STATE4,  FIELDS(FLD_U8(0), FLD_U16(2), FLD_U16(4)),                                        eval_hcc_state4)
+
+#define SCBI_MSG_KEY(PROG, FUNC, MSG) (((uint32_t) (PROG) << 16) | ((uint32_t) (FUNC) << 8) | (uint32_t) (MSG))
+
+#define MSG_IDX(IDENT, PROG, FUNC, MSG, LEN, TYPE, EVENT, FLDS, HANDLER)  MSG_##IDENT,
+#define MSG_DESC(IDENT, PROG, FUNC, MSG, LEN, TYPE, EVENT, FLDS, HANDLER) [MSG_##IDENT] = { #IDENT, LEN, TYPE, EVENT, FLDS, HANDLER },
+#define MSG_CASE(IDENT, PROG, FUNC, MSG, LEN, TYPE, EVENT, FLDS, HANDLER) case SCBI_MSG_KEY(PROG, FUNC, MSG): return &msg_desc[MSG_##IDENT];
+
+enum scbi_msg_idx { SCBI_MSG_TABLE(MSG_IDX) SCBI_MSG_COUNT };
+
+static const struct scbi_msg_desc msg_desc[SCBI_MSG_COUNT] = { SCBI_MSG_TABLE(MSG_DESC) };
+
+static inline const struct scbi_msg_desc * find_msg(const struct scbi_id * id)
+{
+  switch (SCBI_MSG_KEY(id->prog, id->func, id->msg))
+  {
+    SCBI_MSG_TABLE(MSG_CASE)
+    default:
+      return NULL;
   }
 }
 
-static void scbi_parse_format0 (struct scbi_handle * hnd, struct scbi_frame * frame)
+/* pass a decoded msg to the event sink, the fields are typed by the msg table */
+static void emit_event(struct scbi_handle * hnd, const struct scbi_msg_desc * desc, const struct scbi_id * id, const int32_t * field, scbi_time recvd)
 {
-  union scbi_address_id *adid = (union scbi_address_id*) &frame->msg.can_id;
-  switch (adid->scbi_id.prog)
+  struct scbi_event evt;
+
+  evt.type   = desc->event;
+  evt.dev    = hnd->client_dev[id->client];
+  evt.device = hnd->dev_name[evt.dev];
+  evt.client = id->client;
+  evt.func   = id->func;
+  evt.recvd  = recvd;
+  switch (desc->event)
   {
-    case PRG_CONTROLLER:
-      scbi_parse_controller (hnd, frame);
+    case SCBI_EVT_SENSOR:
+      evt.sensor.id    = field[MF_KEY_C];
+      evt.sensor.type  = field[MF_KEY_A];
+      evt.sensor.value = field[MF_VALUE];
+      break;
+    case SCBI_EVT_RELAY:
+      evt.relay.id    = field[MF_KEY_C];
+      evt.relay.mode  = field[MF_KEY_A];
+      evt.relay.efct  = field[MF_KEY_B];
+      evt.relay.value = field[MF_VALUE];
+      break;
+    case SCBI_EVT_OVERVIEW:
+      evt.overview.type       = field[MF_KEY_A];
+      evt.overview.mode       = field[MF_KEY_B];
+      evt.overview.hours      = field[MF_HOURS];
+      evt.overview.heat_yield = field[MF_YIELD];
+      break;
+    case SCBI_EVT_CTR_ANYBODY:
+    case SCBI_EVT_CTR_ALIVE:
+    case SCBI_EVT_CTR_RESET:
+    case SCBI_EVT_CTR_INFO:
+      for (int i = 0; i < 4; i++)
+        evt.controller.data[i] = field[i];
+      break;
+    case SCBI_EVT_HCC_HEATREQ:
+      evt.heat_request.temp  = BYTE2TEMP(field[0]);
+      evt.heat_request.solar = field[1] != 0;
       break;
-    case PRG_DATALOGGER_MONITOR:
-      scbi_parse_datalogger (hnd, frame);
+    case SCBI_EVT_HCC_STATE1:
+      evt.hcc_state1.circuit  = field[0];
+      evt.hcc_state1.state    = field[1];
+      evt.hcc_state1.flow_set = BYTE2TEMP(field[2]);
+      evt.hcc_state1.flow     = BYTE2TEMP(field[3]);
+      evt.hcc_state1.storage  = BYTE2TEMP(field[4]);
       break;
-    case PRG_HCC:
-      scbi_parse_hcc(hnd, frame);
+    case SCBI_EVT_HCC_STATE2:
+      evt.hcc_state2.circuit  = field[0];
+      evt.hcc_state2.wheel    = field[1];
+      evt.hcc_state2.room_set = BYTE2TEMP(field[2]);
+      evt.hcc_state2.room     = BYTE2TEMP(field[3]);
+      evt.hcc_state2.humidity = field[4];
       break;
-    case PRG_REMOTESENSOR:
-    case PRG_DATALOGGER_NAMEDSENSORS:
-    case PRG_AVAILABLERESOURCES:
-    case PRG_PARAMETERSYNCCONFIG:
-    case PRG_ROOMSYNC:
-    case PRG_MSGLOG:
-    case PRG_CBCS:
-      LG_INFO("Program not supported: 0x%02X.", adid->scbi_id.prog);
+    case SCBI_EVT_HCC_STATE3:
+      evt.hcc_state3.circuit   = field[0];
+      evt.hcc_state3.mode      = field[1];
+      evt.hcc_state3.dewpoint  = BYTE2TEMP(field[2]);
+      evt.hcc_state3.pump      = field[3];
+      evt.hcc_state3.on_reason = field[4];
       break;
+    case SCBI_EVT_HCC_STATE4:
+      evt.hcc_state4.circuit = field[0];
+      evt.hcc_state4.min     = BYTE2TEMP(field[1]);
+      evt.hcc_state4.max     = BYTE2TEMP(field[2]);
+      break;
+    default:
+      return;
   }
+  hnd->event_fn(hnd->event_ctx, &evt);
+}
+
+/* decode a complete msg payload - either a single frame or a reassembled bulk transfer, nonzero if it was rejected */
+static int decode_msg (struct scbi_handle * hnd, const struct scbi_id * id, const uint8_t * data, size_t len, scbi_time recvd)
+{
+  const struct scbi_msg_desc * desc = find_msg(id);
+  int32_t field[SCBI_MSG_FIELDS];
+  int     ret = 0;
 
+  if (desc == NULL)
+  {
+    LG_INFO("Msg prog 0x%02X, func 0x%02X, type %u not supported yet.", id->prog, id->func, id->msg);
+    return -1;
+  }
+  if (len < desc->min_len)
+  {
+    LG_INFO("%s msg with wrong data len %u: %s.", desc->name, (unsigned int) len, format_scbi_data(hnd, data, len));
+    return -1;
+  }
+
+  for (int i = 0; i < SCBI_MSG_FIELDS; i++)
+    field[i] = get_field(data, len, &desc->field[i]);
+  if (desc->handler)
+    ret = desc->handler(hnd, desc, id, field);
+  if (ret == 0 && hnd->event_fn)
+    emit_event(hnd, desc, id, field, recvd);
+
+  if (desc->type != SCBI_PARAM_TYPE_NONE)
+  {
+    int lost = ret ? 0 : update_param(hnd, recvd, find_param(hnd, param_key(hnd->client_dev[id->client], desc->type, field[MF_KEY_A], field[MF_KEY_B], field[MF_KEY_C])), field[MF_VALUE]);
+
+    LG_PUSH(ret || lost ? SCBI_LL_ERROR : SCBI_LL_DEBUG, "%s %d/%d/%d -> %d (%s).", desc->name,
+            field[MF_KEY_A], field[MF_KEY_B], field[MF_KEY_C], field[MF_VALUE], format_scbi_data(hnd, data, len));
+  }
+  return ret;
 }
 
+static struct scbi_bulk_slot * find_bulk_slot(struct scbi_handle * hnd, uint32_t key, scbi_time now)
+{
+  struct scbi_bulk_slot * found = NULL;
 
-/* public fct. */
+  for (int i = 0; i < SCBI_BULK_SLOTS; i++)
+  {
+    struct scbi_bulk_slot * slot = &hnd->bulk[i];
+    if (slot->in_use && scbi_time_diff(slot->last_rx, now) > SCBI_BULK_TIMEOUT_MS)
+    {
+      LG_INFO("Bulk transfer 0x%08X abandoned after %u of %u bytes.", slot->key, slot->len, slot->expected);
+      slot->in_use = 0;
+    }
+    if (slot->in_use && slot->key == key)
+      found = slot;
+  }
+  return found;
+}
 
-int scbi_parse(struct scbi_handle * hnd, struct scbi_frame * frame)
+static struct scbi_bulk_slot * alloc_bulk_slot(struct scbi_handle * hnd)
 {
-  union scbi_address_id *  adid = (union scbi_address_id *) &frame->msg.can_id;
-  hnd->now = frame->recvd;
+  struct scbi_bulk_slot * oldest = &hnd->bulk[0];
 
-  if (adid->scbi_id.msg == CAN_MSG_ERROR || adid->scbi_id.flg_err)
+  for (int i = 0; i < SCBI_BULK_SLOTS; i++)
+  {
+    if (!hnd->bulk[i].in_use)
+      return &hnd->bulk[i];
+    if (scbi_time_diff(hnd->bulk[i].last_rx, hnd->now) > scbi_time_diff(oldest->last_rx, hnd->now))
+      oldest = &hnd->bulk[i];
+  }
+  LG_WARN("Bulk transfer slots exhausted, dropping transfer 0x%08X.", oldest->key);
+  return oldest;
+}
+
+/* collect bulk transfer frames, a completed transfer is decoded like any single frame msg */
+static int parse_bulk (struct scbi_handle * hnd, const struct scbi_id * id, struct scbi_frame * frame)
+{
+  uint32_t                key  = frame->msg.can_id & 0x18FFFFFFU;   /* msg, func, client, prog */
+  struct scbi_bulk_slot * slot = find_bulk_slot(hnd, key, frame->recvd);
+  const uint8_t *         data = frame->msg.data;
+  size_t                  len  = frame->msg.len;
+
+  if (len == 0)
+    return -1;
+  if (data[0] == 0)
+  { /* start of transfer - a restarted transfer replaces the pending one */
+    uint16_t expected;
+
+    if (len < SCBI_BULK_HEAD_LEN)
+      return -1;
+    expected = data[1] | ((uint16_t) data[2] << 8);
+    if (expected > SCBI_BULK_MAX_LEN)
+    {
+      LG_WARN("Bulk transfer 0x%08X too long (%u bytes).", key, expected);
+      return -1;
+    }
+    if (slot == NULL)
+      slot = alloc_bulk_slot(hnd);
+    slot->key      = key;
+    slot->in_use   = 1;
+    slot->next_seq = 1;
+    slot->expected = expected;
+    slot->len      = 0;
+    data += SCBI_BULK_HEAD_LEN;
+    len  -= SCBI_BULK_HEAD_LEN;
+  }
+  else
+  {
+    if (slot == NULL)
+    {
+      LG_DEBUG("Bulk frame #%u of unknown transfer 0x%08X.", data[0], key);
+      return -1;
+    }
+    if (data[0] != slot->next_seq)
+    {
+      LG_INFO("Bulk transfer 0x%08X out of sequence (%u, expected %u), dropped.", key, data[0], slot->next_seq);
+      slot->in_use = 0;
+      return -1;
+    }
+    slot->next_seq++;
+    data += SCBI_BULK_NEXT_LEN;
+    len  -= SCBI_BULK_NEXT_LEN;
+  }
+
+  if (len > (size_t) (slot->expected - slot->len))
+    len = slot->expected - slot->len;
+  for (size_t i = 0; i < len; i++)
+    slot->data[slot->len++] = data[i];
+  slot->last_rx = frame->recvd;
+
+  if (slot->len == slot->expected)
+  {
+    slot->in_use = 0;
+    return decode_msg(hnd, id, slot->data, slot->len, frame->recvd);
+  }
+  return 0;
+}
+
+static inline int parse_frame(struct scbi_handle * hnd, struct scbi_frame * frame, int log_frame)
+{
+  struct scbi_id id = scbi_decode_id(frame->msg.can_id);
+  int            ret = -1, rejected = 1;
+
+  if (id.msg == CAN_MSG_ERROR || id.flg_err)
     scbi_print_frame (hnd, SCBI_LL_ERROR, "FRAME", "Frame Error", frame);
   else
   {
-    scbi_print_frame (hnd, SCBI_LL_DEBUG, "FRAME", "Msg", frame);
-    if (adid->scbi_id.prot == CAN_PROTO_FORMAT_0)
+    if (log_frame)
+      scbi_print_frame (hnd, SCBI_LL_DEBUG, "FRAME", "Msg", frame);
+    if (id.prot == CAN_PROTO_FORMAT_0)
     { /* CAN Msgs size <= 8 */
-      scbi_parse_format0 (hnd, frame);
-      return 0;
+      rejected = decode_msg (hnd, &id, frame->msg.data, frame->msg.len, frame->recvd);
+      ret = 0;
     }
+    else if (id.prot == CAN_PROTO_FORMAT_BULK)
+      rejected = ret = parse_bulk (hnd, &id, frame);
   }
-  return -1;
+  if (rejected)
+    hnd->stats.frames_rejected++;
+  else
+  {
+    hnd->stats.frames_parsed++;
+    touch_controller(hnd, id.client);
+  }
+  if (scbi_time_diff(hnd->checked, hnd->now) >= 1000)
+    housekeeping(hnd);
+  return ret;
+}
+
+
+/* public fct. */
+
+int scbi_parse(struct scbi_handle * hnd, struct scbi_frame * frame)
+{
+  hnd->now = frame->recvd;
+  return parse_frame(hnd, frame, LG_ENABLED(SCBI_LL_DEBUG));
+}
+
+/* time passes without frames - lets controllers expire and aggregation windows close on a silent bus */
+void scbi_tick(struct scbi_handle * hnd, scbi_time now)
+{
+  hnd->now = now;
+  if (scbi_time_diff(hnd->checked, hnd->now) >= 1000)
+    housekeeping(hnd);
+}
+
+size_t scbi_parse_many(struct scbi_handle * hnd, struct scbi_frame * frame, size_t cnt)
+{
+  int    log_frame = LG_ENABLED(SCBI_LL_DEBUG);
+  size_t parsed    = 0;
+
+  if (cnt == 0)
+    return 0;
+  for (size_t i = 0; i < cnt; i++)
+  {
+    hnd->now = frame[i].recvd;
+    if (parse_frame(hnd, &frame[i], log_frame) == 0)
+      parsed++;
+  }
+  return parsed;
 }
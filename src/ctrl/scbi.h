@@ -10,6 +10,14 @@ enum scbi_protocol
   CAN_PROTO_FORMAT_UPDATE = 0x02    /* CAN Msg transmitting firmware update */
 };
 
+/* CAN_PROTO_FORMAT_BULK framing (assumed, not covered by the available docs):
+ *   first frame:  0 sequence (0), 1..2 total payload length, 3..7 payload
+ *   next frames:  0 sequence (1, 2, ...), 1..7 payload
+ * the CAN id (prog/client/func/msg) is the same for all frames of a transfer.
+ */
+#define SCBI_BULK_HEAD_LEN 3
+#define SCBI_BULK_NEXT_LEN 1
+
 enum scbi_msg_type
 {
   CAN_MSG_REQUEST  = 0x00,
@@ -19,25 +27,38 @@ enum scbi_msg_type
 };
 
 
-struct scbi_id_format
+/* CAN id layout (29 bit extended id + flags):
+ *   bits  0.. 7 prog, 8..15 client, 16..23 func, 24..26 prot, 27..28 msg,
+ *   bit  29 error, 30 rtr, 31 eff
+ */
+struct scbi_id
 {
   uint8_t prog;
   uint8_t client;
   uint8_t func;
-  uint8_t prot:3;
-  uint8_t msg:2;
-  uint8_t flg_err:1;
-  uint8_t flg_rtr:1;
-  uint8_t flg_eff:1;
-} __attribute__((packed));
-
+  uint8_t prot;
+  uint8_t msg;
+  uint8_t flg_err;
+  uint8_t flg_rtr;
+  uint8_t flg_eff;
+};
 
-union scbi_address_id
+static inline struct scbi_id scbi_decode_id(uint32_t can_id)
 {
-  uint32_t               address_id:29;
-  struct scbi_id_format  scbi_id;
-} __attribute__((packed));
+  struct scbi_id id = {
+    .prog    = can_id & 0xFF,
+    .client  = (can_id >> 8) & 0xFF,
+    .func    = (can_id >> 16) & 0xFF,
+    .prot    = (can_id >> 24) & 0x07,
+    .msg     = (can_id >> 27) & 0x03,
+    .flg_err = (can_id >> 29) & 0x01,
+    .flg_rtr = (can_id >> 30) & 0x01,
+    .flg_eff = (can_id >> 31) & 0x01,
+  };
+  return id;
+}
 
+#define SCBI_ADDRESS_ID(CAN_ID) ((CAN_ID) & 0x1FFFFFFFU)
 
 
 enum scbi_prog_type          /* CAN_FORMAT_0 protocol definitions */
@@ -83,64 +104,15 @@ enum scbi_ctr_function_type    /* PRG_CONTROLLER related functions */
   CTR_DATALOGGER_TEST          = 0x09
 };
 
-struct scbi_ctr_identity_msg  /* SubscriberID.CFG_DEVICE_ID.CFG_OEM_ID.CFG_DEVICE_VARIANT */
-{
-  uint8_t can_id;
-  uint8_t cfg_dev_id;
-  uint8_t cfg_oem_id;
-  uint8_t dev_variant;
-} __attribute__((packed));
-
-
-// message definition for sensor data
-
-struct scbi_dlg_sensor_msg
-{
-  uint8_t  id;
-  int32_t  value;
-  uint8_t  type;       // optional
-  uint8_t  subtype;    // optional
-} __attribute__((packed));
-
-// message definition for relay data
-
-struct scbi_dlg_relay_msg
-{
-  uint8_t id;
-  uint8_t mode;
-  uint8_t value;
-  uint8_t exfunc[2];
-} __attribute__((packed));
-
-// message definition for overview data
-#if 0
-struct scbi_dlg_overview_msg  /* this is the definition from the docs */
-{
-   uint8_t  index:5;
-   uint8_t  type:3;
-   uint16_t hours;
-   uint32_t heat_yield;
-} __attribute__((packed));
-#else
-
-struct scbi_dlg_overview_msg  /* this is the definition by experience */
-{
-   uint8_t  index:5;     /* unused? * */
-   uint8_t  type:3;
-   uint8_t  mode;        /* unknown meaning */
-   uint16_t hours;
-   uint32_t heat_yield;
-} __attribute__((packed));
-#endif
-
-
-
-union scbi_data_logger_msg
-{
-  struct scbi_dlg_overview_msg oview;
-  struct scbi_dlg_sensor_msg   sensor;
-  struct scbi_dlg_relay_msg    relay;
-};
+/* payload layouts (byte offsets, multi byte values little endian) are described by the
+ * message table in scbi.c, some are annotated here for reference:
+ *
+ *   controller identity:  0 can id, 1 device id, 2 OEM id, 3 device variant
+ *   datalogger sensor:    0 id, 1..4 value (signed), 5 type (optional), 6 subtype (optional)
+ *   datalogger relay:     0 id, 1 mode, 2 value, 3..4 external function
+ *   datalogger overview:  0 index (bits 0..4) & type (bits 5..7), 1 mode, 2..3 hours, 4..7 heat yield
+ *                         (the docs omit the mode byte, this is the layout by experience)
+ */
 
 enum scbi_hcc_function_type
 {
@@ -151,56 +123,12 @@ enum scbi_hcc_function_type
   HCC_HEATINGCIRCUIT_STATE4 = 0x04
 };
 
-struct scbi_hcc_heatrequest
-{
-  uint8_t raw_temp;  /* temp range 0-100°C is evenly mapped to byte range, 0-255. to stop heat request send 0. */
-  uint8_t heatsource;  /* 0 for conventional/wood, 1 for solar */
-} __attribute__((packed));
-
-struct scbi_hcc_state_1
-{
-  uint8_t circuit;
-  uint8_t state;
-  uint8_t temp_flowset;
-  uint8_t temp_flow;
-  uint8_t temp_storage;
-} __attribute__((packed));
-
-struct scbi_hcc_state_2
-{
-  uint8_t circuit;
-  uint8_t wheel;
-  uint8_t temp_set;
-  uint8_t temp_room;
-  uint8_t humidity;
-} __attribute__((packed));
-
-struct scbi_hcc_state_3
-{
-  uint8_t circuit;
-  uint8_t op_mode;
-  uint8_t dewpoint;
-  uint8_t pump;
-  uint8_t on_reason;
-} __attribute__((packed));
-
-struct scbi_hcc_state_4
-{
-  uint8_t  circuit;
-  uint8_t  reserved;
-  uint16_t temp_min;
-  uint16_t temp_max;
-} __attribute__((packed));
-
-union scbi_hcc_msg
-{
-   uint8_t                    raw[8];
-  struct scbi_hcc_heatrequest heatreq;
-  struct scbi_hcc_state_1     state1;
-  struct scbi_hcc_state_2     state2;
-  struct scbi_hcc_state_3     state3;
-  struct scbi_hcc_state_4     state4;
-};
+/*   heat request:   0 temp (0..100°C mapped to 0..255, 0 stops the request), 1 heat source (0 conventional/wood, 1 solar)
+ *   hc state 1:     0 circuit, 1 state, 2 flow set temp, 3 flow temp, 4 storage temp
+ *   hc state 2:     0 circuit, 1 wheel, 2 room set temp, 3 room temp, 4 humidity
+ *   hc state 3:     0 circuit, 1 operation mode, 2 dewpoint, 3 pump, 4 on reason
+ *   hc state 4:     0 circuit, 1 reserved, 2..3 min temp, 4..5 max temp
+ */
 
 enum scbi_avail_res_function
 {
@@ -210,25 +138,7 @@ enum scbi_avail_res_function
   EFR_ALL     = 0xFF,
 };
 
-struct scbi_avail_sensor_req_msg
-{
-  uint8_t addr;
-  uint8_t bus;                   /* (1wire/hts,.. -> networkTypes.h) */
-  uint8_t type;                  /* (-> networkTypes.h)              */
-  uint8_t remote_id;             /* which is requested               */
-}__attribute__((packed));
-
-
-
-
-union scbi_msg_content
-{
-  uint8_t                      raw[8];
-  union scbi_data_logger_msg   dlg;
-  struct scbi_ctr_identity_msg identity;
-  union  scbi_hcc_msg          hcc;
-  struct scbi_avail_sensor_req_msg avail_sensor;
-};
+/*   available sensor request: 0 addr, 1 bus (1wire/hts,..), 2 type, 3 remote id */
 
 
 #endif   // _CTRL_SCBI__H
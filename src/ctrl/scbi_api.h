@@ -22,23 +22,75 @@ struct scbi_frame
   scbi_time        recvd;
 };
 
-// datalogger monitor parameter types
+// datalogger monitor and heating circuit parameter types
 enum scbi_param_type
 {
   SCBI_PARAM_TYPE_SENSOR,
   SCBI_PARAM_TYPE_RELAY,
   SCBI_PARAM_TYPE_OVERVIEW,
+  SCBI_PARAM_TYPE_HCC,
+  SCBI_PARAM_TYPE_CONTROLLER,
   SCBI_PARAM_TYPE_COUNT,
   SCBI_PARAM_TYPE_NONE
 };
 
+// statistics of an aggregation window, see scbi_set_aggregation()
+struct scbi_aggregate
+{
+  int32_t  min;
+  int32_t  max;
+  int32_t  mean;                 // rounded
+  uint32_t count;                // samples in the window, zero for parameters without aggregation
+};
+
 struct scbi_param
 {
   enum scbi_param_type type;
   const char *         name;
-  int32_t              value;
+  int32_t              value;    // with aggregation: the last value of the window
+  const char *         device;   // name of the device the parameter was registered for, NULL for SCBI_DEVICE_ANY
+  struct scbi_aggregate aggregate;
+};
+
+// output queue classes, a class is only served while all higher ones are empty or out of tokens
+enum scbi_priority
+{
+  SCBI_PRIO_HIGH,      // default for relays
+  SCBI_PRIO_NORMAL,    // default for sensors
+  SCBI_PRIO_LOW,       // default for overview statistics
+  SCBI_PRIO_CNT
+};
+
+// change filter of a parameter: a value is queued only if it leaves the band around the last published value
+// (or the repost timeout elapsed). The band is the larger one of absolute and relative, all zero queues every change.
+struct scbi_deadband
+{
+  uint32_t absolute;    // in value units
+  uint32_t relative;    // per mille of the last published value
+  uint32_t hysteresis;  // added to the band for changes against the direction of the last published one
 };
 
+// counters of a Sorella instance, they wrap at UINT32_MAX
+struct scbi_stats
+{
+  uint32_t frames_parsed;        // frames decoded, incl. bulk transfer fragments
+  uint32_t frames_rejected;      // error frames, unsupported msgs/protocols, wrong length or content, broken bulk transfers
+  uint32_t frames_unregistered;  // parameter msgs without a registration for their parameter
+  uint32_t queue_full;           // parameter updates lost because the output queue was exhausted
+};
+
+// counters of a registered parameter, they wrap at UINT32_MAX
+struct scbi_param_stats
+{
+  uint32_t received;             // frames carrying the parameter
+  uint32_t suppressed;           // values within the deadband (by default: unchanged) during the repost timeout, not queued
+  uint32_t reposts;              // values within the deadband queued because the repost timeout elapsed
+  uint32_t published;            // values queued for output (changes and reposts)
+};
+
+// device for parameters of all controllers not registered by scbi_register_device
+#define SCBI_DEVICE_ANY 0
+
 enum scbi_dlg_sensor_type
 {
   DST_UNKNOWN          = 0x00,  // default
@@ -136,6 +188,94 @@ enum scbi_dlg_overview_mode
   DOM_COUNT
 };
 
+// values reported by the heating circuit controller, temperatures in °C
+enum scbi_hcc_field
+{
+  SCBI_HCC_HEATREQ_TEMP,         // requested temperature (circuit independent, register with circuit 0)
+  SCBI_HCC_HEATREQ_SOLAR,        // 1: the request is served by solar, 0: conventional
+  SCBI_HCC_STATE,                // state 1
+  SCBI_HCC_FLOW_SET,
+  SCBI_HCC_FLOW,
+  SCBI_HCC_STORAGE,
+  SCBI_HCC_WHEEL,                // state 2
+  SCBI_HCC_ROOM_SET,
+  SCBI_HCC_ROOM,
+  SCBI_HCC_HUMIDITY,             // %
+  SCBI_HCC_MODE,                 // state 3
+  SCBI_HCC_DEWPOINT,
+  SCBI_HCC_PUMP,
+  SCBI_HCC_ON_REASON,
+  SCBI_HCC_TEMP_MIN,             // state 4
+  SCBI_HCC_TEMP_MAX,
+
+  SCBI_HCC_FIELD_COUNT
+};
+
+// presence of the controllers on the bus
+enum scbi_ctr_field
+{
+  SCBI_CTR_ALIVE,                // 1 while the controller sends, 0 after SCBI_CTR_TIMEOUT_MS of silence
+  SCBI_CTR_RESETS,               // resets announced since start
+
+  SCBI_CTR_FIELD_COUNT
+};
+
+// entry of the presence table, see scbi_get_controller()
+struct scbi_controller
+{
+  uint8_t      client;           // CAN client id
+  uint8_t      dev;              // device index its parameters are registered for
+  const char * device;
+  uint8_t      device_id;        // from its identity response, zero until it answered
+  uint8_t      oem_id;
+  uint8_t      variant;
+  uint8_t      alive;
+  scbi_time    first_seen;
+  scbi_time    last_seen;
+  uint32_t     resets;
+};
+
+// kinds of decoded msgs passed to the event sink, see scbi_set_event_sink()
+enum scbi_event_type
+{
+  SCBI_EVT_SENSOR,
+  SCBI_EVT_RELAY,
+  SCBI_EVT_OVERVIEW,
+  SCBI_EVT_CTR_ANYBODY,          // discovery request
+  SCBI_EVT_CTR_ALIVE,            // discovery response
+  SCBI_EVT_CTR_RESET,
+  SCBI_EVT_CTR_INFO,             // identity, program list and date/time responses
+  SCBI_EVT_HCC_HEATREQ,
+  SCBI_EVT_HCC_STATE1,
+  SCBI_EVT_HCC_STATE2,
+  SCBI_EVT_HCC_STATE3,
+  SCBI_EVT_HCC_STATE4,
+  SCBI_EVT_COUNT
+};
+
+// a decoded msg, only valid during the event sink call. Temperatures are in °C.
+struct scbi_event
+{
+  enum scbi_event_type type;
+  uint8_t              dev;      // device of the sending controller, SCBI_DEVICE_ANY if not registered
+  const char *         device;   // name of the device, NULL for SCBI_DEVICE_ANY
+  uint8_t              client;   // CAN client id of the sender
+  uint8_t              func;     // SCBI function of the msg
+  scbi_time            recvd;
+  union
+  {
+    struct { uint8_t id; enum scbi_dlg_sensor_type type; int32_t value; }                                   sensor;
+    struct { uint8_t id; enum scbi_dlg_relay_mode mode; enum scbi_dlg_relay_ext_func efct; uint8_t value; }  relay;
+    struct { enum scbi_dlg_overview_type type; enum scbi_dlg_overview_mode mode; uint16_t hours; uint32_t heat_yield; } overview;
+    struct { uint8_t data[4]; }                                                    controller;   // client id / can id, device id, OEM id, variant
+    struct { uint8_t temp; uint8_t solar; }                                        heat_request; // temp 0: request stopped
+    struct { uint8_t circuit, state, flow_set, flow, storage; }                    hcc_state1;
+    struct { uint8_t circuit, wheel, room_set, room, humidity; }                   hcc_state2;
+    struct { uint8_t circuit, mode, dewpoint, pump, on_reason; }                   hcc_state3;
+    struct { uint8_t circuit; uint16_t min, max; }                                 hcc_state4;
+  };
+};
+
 enum scbi_log_level
 {
   SCBI_LL_CRITICAL,
@@ -151,18 +291,39 @@ struct scbi_handle;
 
 typedef  void * (*    alloc_fn) (size_t __size);
 typedef void    (* log_push_fn) (enum scbi_log_level ll, const char * format, ...);
+typedef void    (* scbi_event_fn) (void * ctx, const struct scbi_event * evt);
 
-struct scbi_handle * scbi_init(alloc_fn alloc, log_push_fn log_push, uint32_t repost_timeout_s);
+struct scbi_handle * scbi_init(alloc_fn alloc, log_push_fn log_push, enum scbi_log_level log_level, uint32_t repost_timeout_s);
+struct scbi_handle * scbi_init_ex(alloc_fn alloc, log_push_fn log_push, enum scbi_log_level log_level, uint32_t repost_timeout_s, size_t max_params);
 
-int scbi_register_sensor(struct scbi_handle * hnd, size_t id, enum scbi_dlg_sensor_type type, const char * entity);
-int scbi_register_relay(struct scbi_handle * hnd, size_t id, enum scbi_dlg_relay_mode mode, enum scbi_dlg_relay_ext_func efct, const char * entity);
-int scbi_register_overview(struct scbi_handle * hnd, enum scbi_dlg_overview_type type, enum scbi_dlg_overview_mode mode, const char * entity);
+int scbi_register_device(struct scbi_handle * hnd, uint8_t client, const char * name);
+int scbi_register_sensor(struct scbi_handle * hnd, size_t dev, size_t id, enum scbi_dlg_sensor_type type, const char * entity);
+int scbi_register_relay(struct scbi_handle * hnd, size_t dev, size_t id, enum scbi_dlg_relay_mode mode, enum scbi_dlg_relay_ext_func efct, const char * entity);
+int scbi_register_overview(struct scbi_handle * hnd, size_t dev, enum scbi_dlg_overview_type type, enum scbi_dlg_overview_mode mode, const char * entity);
+int scbi_register_hcc(struct scbi_handle * hnd, size_t dev, size_t circuit, enum scbi_hcc_field field, const char * entity);
+int scbi_register_controller(struct scbi_handle * hnd, size_t dev, enum scbi_ctr_field field, const char * entity);
+
+int scbi_set_deadband(struct scbi_handle * hnd, size_t dev, const char * entity, const struct scbi_deadband * band);
+int scbi_set_aggregation(struct scbi_handle * hnd, size_t dev, const char * entity, uint32_t window_s);
+int scbi_set_priority(struct scbi_handle * hnd, size_t dev, const char * entity, enum scbi_priority prio);
+int scbi_set_rate_limit(struct scbi_handle * hnd, enum scbi_priority prio, uint32_t rate, uint32_t burst);
+
+size_t scbi_get_can_filters(struct scbi_handle * hnd, struct can_filter * filter, size_t max);
 
 int scbi_parse(struct scbi_handle * hnd, struct scbi_frame * frame);
+size_t scbi_parse_many(struct scbi_handle * hnd, struct scbi_frame * frame, size_t cnt);
+void scbi_tick(struct scbi_handle * hnd, scbi_time now);
 
 struct scbi_param * scbi_peek_param(struct scbi_handle * hnd);
 struct scbi_param * scbi_pop_param(struct scbi_handle * hnd);
 
+void scbi_set_event_sink(struct scbi_handle * hnd, scbi_event_fn fn, void * ctx);
+
+void scbi_get_stats(struct scbi_handle * hnd, struct scbi_stats * stats);
+int  scbi_get_param_stats(struct scbi_handle * hnd, size_t idx, const struct scbi_param ** param, struct scbi_param_stats * stats);
+int  scbi_get_param_index(struct scbi_handle * hnd, const struct scbi_param * param);
+int  scbi_get_controller(struct scbi_handle * hnd, size_t idx, struct scbi_controller * ctr);
+
 void scbi_print_frame (struct scbi_handle * hnd, enum scbi_log_level ll, const char * msg_type, const char * desc, struct scbi_frame * frame);
 
 #endif   // _CTRL_SCBI_API_H
@@ -8,6 +8,8 @@ typedef unsigned char  uint8_t;
 typedef          char   int8_t;
 typedef unsigned short uint16_t;
 typedef          short  int16_t;
+typedef unsigned long long uint64_t;
+typedef          long long  int64_t;
 typedef unsigned int    size_t;
 typedef          int   ssize_t;
 
@@ -15,20 +17,27 @@ typedef          int   ssize_t;
 # define INT8_MIN   (-128)
 # define INT16_MIN  (-32767-1)
 # define INT32_MIN  (-2147483647-1)
+# define INT64_MIN  (-9223372036854775807LL-1)
 /* Maximum of signed integral types.  */
 # define INT8_MAX   (127)
 # define INT16_MAX  (32767)
 # define INT32_MAX  (2147483647)
+# define INT64_MAX  (9223372036854775807LL)
 
 /* Maximum of unsigned integral types.  */
 # define UINT8_MAX  (255)
 # define UINT16_MAX (65535)
 # define UINT32_MAX (4294967295U)
+# define UINT64_MAX (18446744073709551615ULL)
 
 #define NULL ((void *) 0)
 
 #define CAN_MAX_DLEN 8
 
+#define CAN_EFF_FLAG 0x80000000U /* EFF/SFF is set in the MSB */
+#define CAN_RTR_FLAG 0x40000000U /* remote transmission request */
+#define CAN_ERR_FLAG 0x20000000U /* error message frame */
+
 struct can_frame {
   uint32_t can_id;  /* 32 bit CAN_ID + EFF/RTR/ERR flags */
   union {
@@ -45,5 +54,10 @@ struct can_frame {
   uint8_t data[CAN_MAX_DLEN] __attribute__((aligned(8)));
 };
 
+struct can_filter {
+  uint32_t can_id;
+  uint32_t can_mask;
+};
+
 #endif  // _CTRL_SCBI_COMPAT_H_
 
@@ -8,8 +8,22 @@
 // build environment
 #define SCBI_LINUX_SUPPORT
 
-// device featureset (defaults for Sorel MTDCv5)
-#define SCBI_MAX_SENSORS 4
-#define SCBI_MAX_RELAYS 2
+// amount of registrable parameters for instances set up by scbi_init() - scbi_init_ex() sizes them at runtime
+#define SCBI_DEFAULT_MAX_PARAMS 48
+
+// amount of controllers on one bus distinguishable by their CAN client id (max. 15)
+#define SCBI_MAX_DEVICES 8
+
+// controllers tracked per bus by their CAN client id, and the silence after which one is considered lost
+#define SCBI_MAX_CONTROLLERS   16
+#define SCBI_CTR_TIMEOUT_MS    60000
+
+// bulk transfer reassembly: concurrent transfers, max. payload size and timeout for abandoned transfers
+#define SCBI_BULK_SLOTS      4
+#define SCBI_BULK_MAX_LEN    64
+#define SCBI_BULK_TIMEOUT_MS 2000
+
+// least severe log level compiled into the library (eg. SCBI_LL_INFO strips all debug output)
+#define SCBI_LOG_MIN_LEVEL SCBI_LL_DEBUG
 
 #endif  // _CTRL_SCBI_CONFIG_H
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "ctrl/scbi_glue.h"
 
 #include <unistd.h>
@@ -6,30 +7,209 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <net/if.h>
 #include <linux/can.h>
+#include <linux/can/raw.h>
 #include <linux/sockios.h>
 #include <sys/time.h>
+#include <time.h>
 #include <errno.h>
 
 #include "ctrl/scbi_api.h"
-#include "ctrl/com/mqtt.h"
+#include "ctrl/mqtt_link.h"
+#include "ctrl/spool.h"
+#include "ctrl/frame_archive.h"
+#include "ctrl/live_table.h"
+#include "ctrl/exporter.h"
+#include "ctrl/ts_store.h"
 #include "ctrl/logger.h"
 
+#define SCBI_GLUE_RX_BATCH    32  // max. amount of CAN frames fetched by a single recvmmsg call
+#define SCBI_GLUE_TICK_MS     1000  // a silent bus is still ticked, so its controllers expire
+#define SCBI_GLUE_MAX_FILTERS 16  // max. amount of CAN id/mask pairs installed on the socket
+#define SCBI_GLUE_MAX_EVENTS   4  // max. amount of epoll events handled per wakeup
+#define SCBI_GLUE_RING_SIZE  256  // parameters buffered per bus between its reader and the publisher, power of 2
+#define SCBI_GLUE_CACHELINE   64
+#define SCBI_GLUE_BATCH_ITEMS 64  // max. amount of values in a batch, a full batch is published before its window ends
+#define SCBI_GLUE_BATCH_PAYLOAD 2048
+#define SCBI_GLUE_MAX_BATCHES ((SCBI_MAX_DEVICES + 1) * SCBI_PARAM_TYPE_COUNT)
+#define SCBI_GLUE_DRAIN_BATCH 64  // max. amount of spooled messages handed to the broker per wakeup
+#define SCBI_GLUE_HOUSEKEEPING_SEC 1
+#define SCBI_GLUE_COUNTERS_MS 1000  // a bus thread copies its counters for the metrics exporter at most that often
+#define SCBI_GLUE_READ_RETRIES 1000 // the publisher gives up on counters their bus thread doesn't finish copying
+
+/* per stage latency histograms, published every SCBI_GLUE_STATS_SEC on <topic>/$SYS/latency/<stage>.
+ * Build with -DSCBI_GLUE_LATENCY=0 to strip the instrumentation.
+ */
+#ifndef SCBI_GLUE_LATENCY
+  #define SCBI_GLUE_LATENCY 1
+#endif
+#define SCBI_GLUE_LATENCY_BUCKETS 32  // log2 buckets of us, the last one collects everything beyond 2^31us
+#define SCBI_GLUE_STATS_SEC       60
+
+enum scbi_glue_source    /* event sources watched by the publisher event loop */
+{
+  SGS_BUS,
+  SGS_MQTT,
+  SGS_HOUSEKEEPING,
+  SGS_WINDOW,
+  SGS_METRICS
+};
+
+enum scbi_glue_stage     /* latency stages of a value on its way from the CAN bus to the broker */
+{
+  SGL_KERNEL,            // kernel rx timestamp -> frame in user space
+  SGL_PARSE,             // frame in user space -> parameter queued for the publisher
+  SGL_PUBLISH,           // parameter queued -> handed to the broker
+  SGL_COUNT
+};
+
+/* bucket 0 counts latencies below 2us, bucket i those in [2^i, 2^(i+1)) us.
+ * Written by a single thread, read by the publisher - relaxed atomics keep that free of locked instructions.
+ */
+struct scbi_glue_hist
+{
+  _Atomic uint32_t bucket[SCBI_GLUE_LATENCY_BUCKETS];
+  _Atomic uint32_t max_us;
+};
+
+struct scbi_glue_rx
+{
+  struct scbi_frame frame[SCBI_GLUE_RX_BATCH];
+  struct mmsghdr    mmsg [SCBI_GLUE_RX_BATCH];
+  struct iovec      iov  [SCBI_GLUE_RX_BATCH];
+  char              ctrl [SCBI_GLUE_RX_BATCH][CMSG_SPACE(sizeof(struct timeval))];
+};
+
+/* lock-free queue between a single producer (bus thread) and a single consumer (publisher),
+ * head and tail live on separate cache lines so both sides don't invalidate each other on every access.
+ */
+struct scbi_glue_ring
+{
+  _Atomic size_t    head;      // written by the producer only
+  char              pad[SCBI_GLUE_CACHELINE - sizeof(size_t)];
+  _Atomic size_t    tail;      // written by the consumer only
+  char              pad2[SCBI_GLUE_CACHELINE - sizeof(size_t)];
+  struct
+  {
+    struct scbi_param param;
+    uint32_t          idx;     // registration index at the buses Sorella instance
+    uint32_t          stamp;   // queued, see scbi_glue_stamp()
+  } slot[SCBI_GLUE_RING_SIZE];
+};
+
+/* counters of a bus for the metrics exporter, copied by its thread. Guarded by a sequence counter like the
+ * live table slots: odd while the bus thread copies, the publisher retries if it changed while reading.
+ */
+struct scbi_glue_counters
+{
+  _Atomic uint32_t          seq;
+  int64_t                   copied_ms;  // monotonic, bus thread only
+  struct scbi_stats         stats;
+  struct scbi_param_stats * param;
+};
+
+/* publisher side view of a parameter for the metrics exporter, the last value it took from the ring */
+struct scbi_glue_view
+{
+  const struct scbi_param * param;      // name, device and type only - they don't change once parsing started
+  uint32_t                  updates;
+  int32_t                   value;
+  struct scbi_aggregate     aggregate;
+};
+
+struct scbi_glue_bus     /* a CAN interface with its own reader/parser thread and Sorella instance */
+{
+  struct scbi_glue_handle * glue;
+  const char *          port;
+  int                   soc;
+  int                   running;
+  int                   overrun;
+  int                   archive_err;
+  struct fa_writer *    archive;
+  pthread_t             thread;
+  struct scbi_handle *  scbi;
+  size_t                param_cnt;
+  struct scbi_glue_view * view;           // publisher only, with metrics
+  struct scbi_param_stats * counters_copy;// publisher only, with metrics
+  struct scbi_glue_counters counters;
+#if SCBI_GLUE_LATENCY
+  uint64_t              rx_us;   // monotonic time the pending frames were fetched
+  struct scbi_glue_hist hist[SGL_PUBLISH];
+#endif
+  struct scbi_glue_rx   rx;
+  struct scbi_glue_ring ring;
+};
+
+struct scbi_glue_batch   /* values of a bus, device and type collected during a coalescing window */
+{
+  const char *         bus;      // interface name if there are several buses, NULL otherwise
+  const char *         device;
+  enum scbi_param_type type;
+  uint32_t             stamp;    // of the batches oldest value
+  size_t               cnt;
+  struct
+  {
+    const char *       name;
+    int32_t            value;
+    struct scbi_aggregate aggregate;
+  } item[SCBI_GLUE_BATCH_ITEMS];
+};
+
 struct scbi_glue_handle
 {
-  int                  soc;
-  struct mqtt_handle * broker;
-  struct scbi_handle * scbi;
+  int                  epfd;
+  int                  housekeeping;
+  int                  notify;   // eventfd, bus threads -> publisher: rings got new parameters
+  int                  stop;     // eventfd, publisher -> bus threads: terminate
+  int                  window;   // timerfd, ends the current coalescing window
+  int                  window_armed;
+  int                  mqtt_fd;
+  uint32_t             mqtt_events;
+  struct mqtt_link *   broker;
+  struct spool *       spool;
+  int                  spool_overrun;
+  struct lt_writer *   live;
+  struct exporter *    metrics;
+  struct ts_store *    store;
+  int                  store_ticks;
   struct timeval       start;
+  struct scbi_glue_config config;
+#if SCBI_GLUE_LATENCY
+  int                  stats_ticks;
+  struct scbi_glue_hist hist;   // SGL_PUBLISH
+#endif
+  size_t               batch_cnt;
+  struct scbi_glue_batch batch[SCBI_GLUE_MAX_BATCHES];
+  size_t               bus_cnt;
+  struct scbi_glue_bus bus[];
 };
 
 static const char * param_type_translate[] = {
     "sensor",    /* SCBI_PARAM_TYPE_SENSOR     */
     "relay",     /* SCBI_PARAM_TYPE_RELAY      */
-    "overview"   /* SCBI_PARAM_TYPE_OVERVIEW   */
+    "overview",  /* SCBI_PARAM_TYPE_OVERVIEW   */
+    "hcc",       /* SCBI_PARAM_TYPE_HCC        */
+    "controller" /* SCBI_PARAM_TYPE_CONTROLLER */
 };
 
+#if SCBI_GLUE_LATENCY
+static const char * stage_translate[] = {
+    "kernel",    /* SGL_KERNEL  */
+    "parse",     /* SGL_PARSE   */
+    "publish"    /* SGL_PUBLISH */
+};
+#endif
+
 static enum log_level lltranslate[] = {
   LL_CRITICAL, /* SCBI_LL_CRITICAL, */
   LL_ERROR,    /* SCBI_LL_ERROR,    */
@@ -51,108 +231,1004 @@ void scbi_glue_log(enum scbi_log_level scbi_ll, const char * format, ...)
   }
 }
 
+/* most verbose Sorella log level currently enabled in the logger */
+enum scbi_log_level scbi_glue_log_level(void)
+{
+  enum scbi_log_level ll = SCBI_LL_DEBUG;
+
+  while (ll > SCBI_LL_CRITICAL && !log_get_level_state(lltranslate[ll]))
+    ll--;
+  return ll;
+}
+
 
-struct scbi_glue_handle * scbi_glue_create (struct scbi_handle * scbi_hnd, const char *port, void * broker)
+static int scbi_glue_watch(struct scbi_glue_handle * hnd, int op, int fd, uint32_t events, enum scbi_glue_source src)
+{
+  struct epoll_event ev = { .events = events, .data.u32 = src };
+  return epoll_ctl(hnd->epfd, op, fd, &ev);
+}
+
+/* keep the epoll registration in line with the brokers socket (which changes on reconnect) and pending output */
+static void scbi_glue_watch_mqtt(struct scbi_glue_handle * hnd)
+{
+  int      fd;
+  uint32_t events;
+
+  fd = mqtt_link_socket(hnd->broker);
+  events = EPOLLIN | (mqtt_link_want_write(hnd->broker) ? EPOLLOUT : 0);
+  /* while (re)connecting the descriptor may have been closed and reissued under the same number - always refresh */
+  if (fd == hnd->mqtt_fd && events == hnd->mqtt_events && mqtt_link_connected(hnd->broker))
+    return;
+  if (fd != hnd->mqtt_fd)
+  {
+    if (hnd->mqtt_fd >= 0)
+      epoll_ctl(hnd->epfd, EPOLL_CTL_DEL, hnd->mqtt_fd, NULL);
+    hnd->mqtt_fd = -1;
+    if (fd >= 0 && scbi_glue_watch(hnd, EPOLL_CTL_ADD, fd, events, SGS_MQTT) == 0)
+      hnd->mqtt_fd = fd;
+  }
+  else if (scbi_glue_watch(hnd, EPOLL_CTL_MOD, fd, events, SGS_MQTT) < 0 &&
+           (errno != ENOENT || scbi_glue_watch(hnd, EPOLL_CTL_ADD, fd, events, SGS_MQTT) < 0))
+    LG_ERROR("Could not update MQTT event registration. Error: %s", strerror(errno));
+  hnd->mqtt_events = events;
+}
+
+/* let the kernel drop all frames not carrying anything of interest for the parser - unless they are archived,
+ * the archive is meant to hold every frame on the bus */
+static void scbi_glue_set_filter(struct scbi_glue_bus * bus)
+{
+  struct can_filter filter[SCBI_GLUE_MAX_FILTERS];
+  size_t cnt;
+
+  if (bus->glue->config.archive_prefix)
+  {
+    LG_INFO("%s: Archiving all frames, receiving unfiltered.", bus->port);
+    return;
+  }
+  cnt = scbi_get_can_filters(bus->scbi, filter, SCBI_GLUE_MAX_FILTERS);
+  if (cnt > SCBI_GLUE_MAX_FILTERS)
+  {
+    LG_WARN("%s: Too many CAN filters requested (%zu), receiving unfiltered.", bus->port, cnt);
+    return;
+  }
+  if (setsockopt (bus->soc, SOL_CAN_RAW, CAN_RAW_FILTER, filter, cnt * sizeof(filter[0])) < 0)
+    LG_WARN("%s: Could not install CAN filters, receiving unfiltered. Error: %s", bus->port, strerror(errno));
+  else
+    LG_INFO("%s: Installed %zu CAN filters.", bus->port, cnt);
+}
+
+static int scbi_glue_ring_push(struct scbi_glue_ring * ring, const struct scbi_param * param, uint32_t idx, uint32_t stamp)
+{
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= SCBI_GLUE_RING_SIZE)
+    return -1;
+  ring->slot[head & (SCBI_GLUE_RING_SIZE - 1)].param = *param;
+  ring->slot[head & (SCBI_GLUE_RING_SIZE - 1)].idx   = idx;
+  ring->slot[head & (SCBI_GLUE_RING_SIZE - 1)].stamp = stamp;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 0;
+}
+
+static int scbi_glue_ring_pop(struct scbi_glue_ring * ring, struct scbi_param * param, uint32_t * idx, uint32_t * stamp)
+{
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  if (tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+    return -1;
+  *param = ring->slot[tail & (SCBI_GLUE_RING_SIZE - 1)].param;
+  *idx   = ring->slot[tail & (SCBI_GLUE_RING_SIZE - 1)].idx;
+  *stamp = ring->slot[tail & (SCBI_GLUE_RING_SIZE - 1)].stamp;
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return 0;
+}
+
+static inline int64_t scbi_glue_mono_ms(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* bus thread: copy the counters of its Sorella instance for the publisher */
+static void scbi_glue_copy_counters(struct scbi_glue_bus * bus, int64_t now_ms)
+{
+  uint32_t seq = atomic_load_explicit(&bus->counters.seq, memory_order_relaxed);
+
+  atomic_store_explicit(&bus->counters.seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  scbi_get_stats(bus->scbi, &bus->counters.stats);
+  for (size_t idx = 0; idx < bus->param_cnt; idx++)
+    scbi_get_param_stats(bus->scbi, idx, NULL, &bus->counters.param[idx]);
+  atomic_store_explicit(&bus->counters.seq, seq + 2, memory_order_release);
+  bus->counters.copied_ms = now_ms;
+}
+
+/* publisher: consistent copy of a buses counters, -1 if its thread is stuck in the middle of copying them */
+static int scbi_glue_read_counters(struct scbi_glue_bus * bus, struct scbi_stats * stats)
+{
+  for (int i = 0; i < SCBI_GLUE_READ_RETRIES; i++)
+  {
+    uint32_t seq = atomic_load_explicit(&bus->counters.seq, memory_order_acquire);
+
+    if (seq & 1)
+    {
+      sched_yield();
+      continue;
+    }
+    *stats = bus->counters.stats;
+    memcpy(bus->counters_copy, bus->counters.param, bus->param_cnt * sizeof(struct scbi_param_stats));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&bus->counters.seq, memory_order_relaxed) == seq)
+      return 0;
+  }
+  return -1;
+}
+
+#if SCBI_GLUE_LATENCY
+static inline uint64_t scbi_glue_now_us(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static inline void scbi_glue_hist_add(struct scbi_glue_hist * hist, uint64_t us)
+{
+  int b = us < 2 ? 0 : 63 - __builtin_clzll(us);
+
+  if (b >= SCBI_GLUE_LATENCY_BUCKETS)
+    b = SCBI_GLUE_LATENCY_BUCKETS - 1;
+  if (us > UINT32_MAX)
+    us = UINT32_MAX;
+  atomic_store_explicit(&hist->bucket[b], atomic_load_explicit(&hist->bucket[b], memory_order_relaxed) + 1, memory_order_relaxed);
+  if (us > atomic_load_explicit(&hist->max_us, memory_order_relaxed))
+    atomic_store_explicit(&hist->max_us, us, memory_order_relaxed);
+}
+
+/* monotonic ms a value was queued for publishing, it travels through the spool and wraps like any 32 bit ms clock.
+ * Zero marks messages not to be tracked.
+ */
+static inline uint32_t scbi_glue_stamp(uint64_t now_us)
+{
+  uint32_t stamp = now_us / 1000;
+
+  return stamp ? stamp : 1;
+}
+#endif
+
+
+static int scbi_glue_open_bus(struct scbi_glue_bus * bus)
 {
   struct ifreq ifr;
   struct sockaddr_can addr;
-  struct scbi_glue_handle * hnd = calloc (1, sizeof(struct scbi_glue_handle));
 
-  gettimeofday(&hnd->start, NULL);
+  bus->soc = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (bus->soc < 0)
+  {
+    LG_CRITICAL("%s: Could not open CAN interface. Error: %s", bus->port, strerror(errno));
+    return -1;
+  }
+
+  addr.can_family = AF_CAN;
+  strncpy (ifr.ifr_name, bus->port, sizeof(ifr.ifr_name) - 1);
+  ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
+  if (ioctl (bus->soc, SIOCGIFINDEX, &ifr) < 0)
+  {
+    LG_CRITICAL("%s: Could not address CAN interface. Error: %s", bus->port, strerror(errno));
+    return -1;
+  }
+  addr.can_ifindex = ifr.ifr_ifindex;
+  fcntl (bus->soc, F_SETFL, O_NONBLOCK);
+  /* let the kernel deliver rx timestamps in-band instead of querying them per frame */
+  if (setsockopt (bus->soc, SOL_SOCKET, SO_TIMESTAMP, &(int) { 1 }, sizeof(int)) < 0)
+    LG_WARN("%s: Could not enable CAN rx timestamps, falling back to user space time. Error: %s", bus->port, strerror(errno));
+  if (bind (bus->soc, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+  {
+    LG_CRITICAL("%s: Could not bind to CAN interface. Error: %s", bus->port, strerror(errno));
+    return -1;
+  }
+  scbi_glue_set_filter(bus);
+
+  for (int i = 0; i < SCBI_GLUE_RX_BATCH; i++)
+  {
+    bus->rx.iov[i].iov_base = &bus->rx.frame[i].msg;
+    bus->rx.iov[i].iov_len  = sizeof(bus->rx.frame[i].msg);
+    bus->rx.mmsg[i].msg_hdr.msg_iov    = &bus->rx.iov[i];
+    bus->rx.mmsg[i].msg_hdr.msg_iovlen = 1;
+  }
+  if (bus->glue->config.archive_prefix)
+  {
+    int64_t base_ms = (int64_t) bus->glue->start.tv_sec * 1000 + bus->glue->start.tv_usec / 1000;
+
+    bus->archive = fa_writer_open(bus->glue->config.archive_prefix, bus->port, base_ms, bus->glue->config.archive_size);
+    if (bus->archive == NULL)
+    {
+      LG_CRITICAL("%s: Could not create frame archive %s. Error: %s", bus->port, bus->glue->config.archive_prefix, strerror(errno));
+      return -1;
+    }
+  }
+  LG_INFO("%s: CAN interface ready.", bus->port);
+  return 0;
+}
+
+static int64_t scbi_glue_wall_ms(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void * scbi_glue_bus_thread(void * arg);
+static void scbi_glue_render_metrics(void * ctx, struct exporter_page * page);
+
+struct scbi_glue_handle * scbi_glue_create (struct scbi_handle ** scbi_hnd, const char ** port, size_t cnt, void * broker,
+                                            const struct scbi_glue_config * config)
+{
+  struct itimerspec housekeeping = { { SCBI_GLUE_HOUSEKEEPING_SEC, 0 }, { SCBI_GLUE_HOUSEKEEPING_SEC, 0 } };
+  struct scbi_glue_handle * hnd = calloc (1, sizeof(struct scbi_glue_handle) + cnt * sizeof(struct scbi_glue_bus));
+  sigset_t all, prev;
 
   LG_INFO("Initializing Sorel CAN Msg parser.");
 
+  if (cnt == 0 || broker == NULL)
+  {
+    LG_CRITICAL("No CAN interface or broker given.");
+    free(hnd);
+    return NULL;
+  }
   if (hnd == NULL)
   {
     LG_CRITICAL("Could not allocate ressources for Sorel CAN Msg parser.");
     return NULL;
   }
+  gettimeofday(&hnd->start, NULL);
+  hnd->epfd = hnd->housekeeping = hnd->notify = hnd->stop = hnd->window = hnd->mqtt_fd = -1;
+  hnd->broker = broker;
+  if (config)
+    hnd->config = *config;
+  hnd->bus_cnt = cnt;
+  for (size_t i = 0; i < cnt; i++)
+  {
+    struct scbi_glue_bus * bus = &hnd->bus[i];
+
+    bus->glue = hnd;
+    bus->port = port[i];
+    bus->scbi = scbi_hnd[i];
+    bus->soc  = -1;
+    while (scbi_get_param_stats(bus->scbi, bus->param_cnt, NULL, NULL) == 0)
+      bus->param_cnt++;
+  }
+  for (size_t i = 0; i < cnt && hnd->config.metrics_addr; i++)
+  {
+    struct scbi_glue_bus * bus = &hnd->bus[i];
 
-  hnd->soc = socket(PF_CAN, SOCK_RAW, CAN_RAW);
-  if (hnd->soc < 0)
+    bus->view           = calloc(bus->param_cnt + 1, sizeof(struct scbi_glue_view));
+    bus->counters.param = calloc(bus->param_cnt + 1, sizeof(struct scbi_param_stats));
+    bus->counters_copy  = calloc(bus->param_cnt + 1, sizeof(struct scbi_param_stats));
+    if (bus->view == NULL || bus->counters.param == NULL || bus->counters_copy == NULL)
+    {
+      LG_CRITICAL("Could not allocate ressources for the metrics of %s.", bus->port);
+      scbi_glue_destroy(hnd);
+      return NULL;
+    }
+    for (size_t idx = 0; idx < bus->param_cnt; idx++)
+      scbi_get_param_stats(bus->scbi, idx, &bus->view[idx].param, NULL);
+  }
+  hnd->spool = spool_open(hnd->config.spool_path, hnd->config.spool_size);
+  if (hnd->spool == NULL)
   {
-    LG_CRITICAL("Could not open CAN interface. Error: %s", strerror(errno));
     scbi_glue_destroy(hnd);
     return NULL;
   }
+  for (size_t i = 0; i < cnt; i++)
+  {
+    if (scbi_glue_open_bus(&hnd->bus[i]) < 0)
+    {
+      scbi_glue_destroy(hnd);
+      return NULL;
+    }
+  }
+  if (hnd->config.live_name)
+  {
+    hnd->live = lt_writer_open(hnd->config.live_name, scbi_hnd, port, cnt);
+    if (hnd->live == NULL)
+    {
+      LG_CRITICAL("Could not create live value table %s. Error: %s", hnd->config.live_name, strerror(errno));
+      scbi_glue_destroy(hnd);
+      return NULL;
+    }
+    lt_writer_alive(hnd->live, scbi_glue_wall_ms());
+  }
+  if (hnd->config.ts_dir)
+  {
+    size_t resized, discarded;
 
-  addr.can_family = AF_CAN;
-  strcpy (ifr.ifr_name, port);
-  if (ioctl (hnd->soc, SIOCGIFINDEX, &ifr) < 0)
+    hnd->store = ts_store_open(hnd->config.ts_dir, hnd->config.ts_size, scbi_hnd, port, cnt);
+    if (hnd->store == NULL)
+    {
+      LG_CRITICAL("Could not open time series store in %s. Error: %s", hnd->config.ts_dir, strerror(errno));
+      scbi_glue_destroy(hnd);
+      return NULL;
+    }
+    ts_store_get_open_stats(hnd->store, &resized, &discarded);
+    if (resized)
+      LG_INFO("Copied %zu time series to the new block count of the size limit.", resized);
+    if (discarded)
+      LG_WARN("Discarded %zu incompatible or damaged time series in %s.", discarded, hnd->config.ts_dir);
+  }
+
+  hnd->epfd = epoll_create1(EPOLL_CLOEXEC);
+  hnd->housekeeping = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  hnd->notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  hnd->stop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  hnd->window = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (hnd->epfd < 0 || hnd->housekeeping < 0 || hnd->notify < 0 || hnd->stop < 0 || hnd->window < 0 ||
+      timerfd_settime(hnd->housekeeping, 0, &housekeeping, NULL) < 0 ||
+      scbi_glue_watch(hnd, EPOLL_CTL_ADD, hnd->notify, EPOLLIN, SGS_BUS) < 0 ||
+      scbi_glue_watch(hnd, EPOLL_CTL_ADD, hnd->housekeeping, EPOLLIN, SGS_HOUSEKEEPING) < 0 ||
+      scbi_glue_watch(hnd, EPOLL_CTL_ADD, hnd->window, EPOLLIN, SGS_WINDOW) < 0)
   {
-    LG_CRITICAL("Could not address CAN interface. Error: %s", strerror(errno));
+    LG_CRITICAL("Could not set up event loop. Error: %s", strerror(errno));
     scbi_glue_destroy(hnd);
     return NULL;
   }
-  addr.can_ifindex = ifr.ifr_ifindex;
-  fcntl (hnd->soc, F_SETFL, O_NONBLOCK);
-  if (bind (hnd->soc, (struct sockaddr*) &addr, sizeof(addr)) < 0)
+  if (hnd->config.metrics_addr)
+  {
+    hnd->metrics = exporter_open(hnd->config.metrics_addr, scbi_glue_render_metrics, hnd);
+    if (hnd->metrics == NULL || scbi_glue_watch(hnd, EPOLL_CTL_ADD, exporter_fd(hnd->metrics), EPOLLIN, SGS_METRICS) < 0)
+    {
+      LG_CRITICAL("Could not serve metrics on %s. Error: %s", hnd->config.metrics_addr, strerror(errno));
+      scbi_glue_destroy(hnd);
+      return NULL;
+    }
+  }
+
+  /* signals are left to the publisher, its event loop wakes up on them */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &prev);
+  for (size_t i = 0; i < cnt; i++)
+  {
+    int err = pthread_create(&hnd->bus[i].thread, NULL, scbi_glue_bus_thread, &hnd->bus[i]);
+    if (err)
+    {
+      LG_CRITICAL("%s: Could not start reader thread. Error: %s", hnd->bus[i].port, strerror(err));
+      break;
+    }
+    hnd->bus[i].running = 1;
+  }
+  pthread_sigmask(SIG_SETMASK, &prev, NULL);
+  if (!hnd->bus[cnt - 1].running)
   {
-    LG_CRITICAL("Could not bind to CAN interface. Error: %s", strerror(errno));
     scbi_glue_destroy(hnd);
     return NULL;
   }
-  hnd->broker = broker;
-  hnd->scbi = scbi_hnd;
+  scbi_glue_watch_mqtt(hnd);
   return hnd;
 }
 
 
-void scbi_glue_update (struct scbi_glue_handle * hnd)
+/* extract the kernel rx timestamp from a received msgs ancillary data, fall back to the time it was fetched if there is none */
+static scbi_time scbi_glue_rx_time(struct scbi_glue_bus * bus, struct msghdr * hdr, const struct timeval * fetched)
 {
-  struct scbi_frame       frame;
-  struct timeval          tstamp;
-  struct scbi_param *     param;
-  int                     rx;
-  struct timeval timeout = { 1, 0 };
-  fd_set readSet;
+  struct timeval   tstamp;
+  struct cmsghdr * cmsg;
 
-  FD_ZERO(&readSet);
-  FD_SET(hnd->soc, &readSet);
-  if (select ((hnd->soc + 1), &readSet, NULL, NULL, &timeout) >= 0)
+  for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg))
   {
-    if (FD_ISSET(hnd->soc, &readSet))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP)
+      break;
+  }
+  if (cmsg)
+  {
+    memcpy(&tstamp, CMSG_DATA(cmsg), sizeof(tstamp));
+#if SCBI_GLUE_LATENCY
+    struct timeval delay;
+
+    timersub(fetched, &tstamp, &delay);
+    if (delay.tv_sec >= 0)
+      scbi_glue_hist_add(&bus->hist[SGL_KERNEL], (uint64_t) delay.tv_sec * 1000000 + delay.tv_usec);
+#endif
+  }
+  else
+    tstamp = *fetched;
+  timersub(&tstamp, &bus->glue->start, &tstamp);
+  return (tstamp.tv_sec * 1000) + (tstamp.tv_usec / 1000);
+}
+
+/* drain the CAN socket in batches, returns the amount of successfully parsed frames or -1 on error */
+static int scbi_glue_receive(struct scbi_glue_bus * bus)
+{
+  struct timeval fetched;
+  int rx, parsed = 0;
+
+  do
+  {
+    for (int i = 0; i < SCBI_GLUE_RX_BATCH; i++)
+    {
+      bus->rx.mmsg[i].msg_hdr.msg_control    = bus->rx.ctrl[i];
+      bus->rx.mmsg[i].msg_hdr.msg_controllen = sizeof(bus->rx.ctrl[i]);
+    }
+    rx = recvmmsg (bus->soc, bus->rx.mmsg, SCBI_GLUE_RX_BATCH, MSG_DONTWAIT, NULL);
+    if (rx < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        break;
+      LG_ERROR("%s: Reading CAN Bus: Posix Error (%i) '%s'.\n", bus->port, errno, strerror(errno));
+      return -1;
+    }
+    gettimeofday(&fetched, NULL);
+#if SCBI_GLUE_LATENCY
+    if (parsed == 0)
+      bus->rx_us = scbi_glue_now_us();
+#endif
+
+    int valid = 0;
+
+    for (int i = 0; i < rx; i++)
+    {
+      struct scbi_frame * frame = &bus->rx.frame[i];
+
+      if (bus->rx.mmsg[i].msg_len < sizeof(struct can_frame))
+      {
+        LG_ERROR("%s: Received a frame of %u bytes only, dropped.", bus->port, (unsigned int) bus->rx.mmsg[i].msg_len);
+        continue;   /* its buffer still holds (parts of) a previous frame, nothing worth printing */
+      }
+      frame->recvd = scbi_glue_rx_time(bus, &bus->rx.mmsg[i].msg_hdr, &fetched);
+      if (valid != i)
+        bus->rx.frame[valid] = *frame;
+      valid++;
+    }
+    if (bus->archive && fa_writer_put(bus->archive, bus->rx.frame, valid) < 0 && !bus->archive_err)
+    {
+      LG_ERROR("%s: Writing frame archive failed. Error: %s", bus->port, strerror(errno));
+      bus->archive_err = 1;
+    }
+    parsed += scbi_parse_many(bus->scbi, bus->rx.frame, valid);
+  } while (rx == SCBI_GLUE_RX_BATCH);
+
+  return parsed;
+}
+
+/* hand the parsed parameters over to the publisher, never blocks - drops if the publisher can't keep up.
+ * received: they stem from the frames fetched at rx_us, the ones of a tick (closed aggregation windows) have
+ * no frame to measure the parse latency from */
+static void scbi_glue_forward(struct scbi_glue_bus * bus, int received)
+{
+  struct scbi_param * param;
+  int                 pushed = 0;
+#if SCBI_GLUE_LATENCY
+  uint64_t            now   = scbi_glue_now_us();
+  uint32_t            stamp = scbi_glue_stamp(now);
+#else
+  uint32_t            stamp = 0;
+#endif
+
+  while ((param = scbi_pop_param(bus->scbi)) != NULL)
+  {
+    int idx = scbi_get_param_index(bus->scbi, param);
+
+    if (param->type >= SCBI_PARAM_TYPE_COUNT || idx < 0)
+      continue;
+    if (scbi_glue_ring_push(&bus->ring, param, idx, stamp) < 0)
+    {
+      if (!bus->overrun)
+        LG_WARN("%s: Publisher queue full, dropping parameters.", bus->port);
+      bus->overrun = 1;
+      continue;
+    }
+    bus->overrun = 0;
+    pushed++;
+#if SCBI_GLUE_LATENCY
+    if (received)
+      scbi_glue_hist_add(&bus->hist[SGL_PARSE], now - bus->rx_us);
+#endif
+  }
+  if (pushed && write(bus->glue->notify, &(uint64_t) { 1 }, sizeof(uint64_t)) < 0 && errno != EAGAIN)
+    LG_ERROR("%s: Notifying publisher: Posix Error (%i) '%s'.", bus->port, errno, strerror(errno));
+}
+
+static void * scbi_glue_bus_thread(void * arg)
+{
+  struct scbi_glue_bus * bus = arg;
+  struct pollfd          pfd[2] = { { .fd = bus->soc, .events = POLLIN }, { .fd = bus->glue->stop, .events = POLLIN } };
+
+  for (;;)
+  {
+    int rc = poll(pfd, 2, SCBI_GLUE_TICK_MS);
+
+    if (rc < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      LG_CRITICAL("%s: Reader loop: Posix Error (%i) '%s'.", bus->port, errno, strerror(errno));
+      break;
+    }
+    if (rc == 0)
+    {
+      struct timeval now;
+
+      gettimeofday(&now, NULL);
+      timersub(&now, &bus->glue->start, &now);
+      scbi_tick(bus->scbi, now.tv_sec * 1000 + now.tv_usec / 1000);
+      scbi_glue_forward(bus, 0);
+    }
+    else if (pfd[1].revents)
+      break;
+    else if (pfd[0].revents && scbi_glue_receive(bus) > 0)
+      scbi_glue_forward(bus, 1);
+    if (bus->counters.param)
+    {
+      int64_t now_ms = scbi_glue_mono_ms();
+
+      if (now_ms - bus->counters.copied_ms >= SCBI_GLUE_COUNTERS_MS)
+        scbi_glue_copy_counters(bus, now_ms);
+    }
+  }
+  return NULL;
+}
+
+static void scbi_glue_enqueue(struct scbi_glue_handle * hnd, const char * topic, const char * payload, int len, uint32_t stamp)
+{
+  int rc = spool_append(hnd->spool, topic, payload, len, stamp);
+
+  if (rc < 0)
+    LG_ERROR("Message for %s doesn't fit into the spool.", topic);
+  else if (rc > 0 && !hnd->spool_overrun)
+  {
+    LG_WARN("Spool full, dropping the oldest messages.");
+    hnd->spool_overrun = 1;
+  }
+}
+
+/* a plain value or an aggregate {"last":..,"min":..,"max":..,"mean":..,"count":..} */
+static int scbi_glue_format_value(char * buf, size_t size, int32_t value, const struct scbi_aggregate * agg)
+{
+  if (agg->count == 0)
+    return snprintf(buf, size, "%d", (int) value);
+  return snprintf(buf, size, "{\"last\":%d,\"min\":%d,\"max\":%d,\"mean\":%d,\"count\":%u}",
+                  (int) value, (int) agg->min, (int) agg->max, (int) agg->mean, (unsigned int) agg->count);
+}
+
+static void scbi_glue_enqueue_value(struct scbi_glue_handle * hnd, const char * bus, const struct scbi_param * param, uint32_t stamp)
+{
+  char topic[MQTT_LINK_TOPIC_LEN];
+  char payload[96];
+  int  len;
+
+  if (mqtt_link_topic(hnd->broker, topic, sizeof(topic), bus, param->device, param_type_translate[param->type], param->name) < 0)
+  {
+    LG_ERROR("Topic for %s too long.", param->name);
+    return;
+  }
+  len = scbi_glue_format_value(payload, sizeof(payload), param->value, &param->aggregate);
+  scbi_glue_enqueue(hnd, topic, payload, len, stamp);
+}
+
+static void scbi_glue_enqueue_batch(struct scbi_glue_handle * hnd, struct scbi_glue_batch * batch, const char * payload, int len)
+{
+  char topic[MQTT_LINK_TOPIC_LEN];
+
+  if (mqtt_link_topic(hnd->broker, topic, sizeof(topic), batch->bus, batch->device, param_type_translate[batch->type], NULL) < 0)
+    LG_ERROR("Topic for %s batch too long.", param_type_translate[batch->type]);
+  else
+    scbi_glue_enqueue(hnd, topic, payload, len, batch->stamp);
+}
+
+/* hand spooled messages to the broker in order - a bounded amount per wakeup, the rest follows once the socket took them */
+static void scbi_glue_drain(struct scbi_glue_handle * hnd)
+{
+  const char * topic;
+  const void * payload;
+  size_t       len;
+  uint32_t     stamp;
+#if SCBI_GLUE_LATENCY
+  uint32_t     now = 0;
+#endif
+
+  for (int i = 0; i < SCBI_GLUE_DRAIN_BATCH && mqtt_link_connected(hnd->broker); i++)
+  {
+    if (spool_peek(hnd->spool, &topic, &payload, &len, &stamp) < 0 || mqtt_link_send(hnd->broker, topic, payload, len) < 0)
+      break;
+    spool_consume(hnd->spool);
+#if SCBI_GLUE_LATENCY
+    if (stamp)
+    {
+      if (now == 0)
+        now = scbi_glue_stamp(scbi_glue_now_us());
+      scbi_glue_hist_add(&hnd->hist, (uint64_t) (uint32_t) (now - stamp) * 1000);
+    }
+#endif
+  }
+  if (spool_pending(hnd->spool) == 0)
+    hnd->spool_overrun = 0;
+}
+
+/* publish a batch as a json object {"<name>":<value>,...}, split into several messages if it doesn't fit into one payload */
+static void scbi_glue_flush_batch(struct scbi_glue_handle * hnd, struct scbi_glue_batch * batch)
+{
+  char payload[SCBI_GLUE_BATCH_PAYLOAD];
+  int  len = 0;
+
+  for (size_t i = 0; i < batch->cnt; i++)
+  {
+    int n = snprintf(payload + len, sizeof(payload) - len, "%c\"%s\":", len ? ',' : '{', batch->item[i].name);
+
+    if (n >= 0 && len + n < (int) sizeof(payload))
     {
-      rx = read (hnd->soc, &frame.msg, sizeof(frame.msg));
-      if (rx < 0)
+      int v = scbi_glue_format_value(payload + len + n, sizeof(payload) - len - n, batch->item[i].value, &batch->item[i].aggregate);
+      n = v < 0 ? v : n + v;
+    }
+    if (n < 0 || len + n + 1 >= (int) sizeof(payload))   /* keep room for the closing brace */
+    {
+      if (len == 0)
       {
-        LG_ERROR("Reading CAN Bus: Posix Error (%i) '%s'.\n", errno, strerror(errno));
-        return;
+        LG_ERROR("Parameter name '%s' too long for a batch.", batch->item[i].name);
+        continue;
       }
+      payload[len++] = '}';
+      scbi_glue_enqueue_batch(hnd, batch, payload, len);
+      len = 0;
+      i--;
+      continue;
+    }
+    len += n;
+  }
+  if (len)
+  {
+    payload[len++] = '}';
+    scbi_glue_enqueue_batch(hnd, batch, payload, len);
+  }
+  batch->cnt = 0;
+}
+
+static void scbi_glue_flush(struct scbi_glue_handle * hnd)
+{
+  for (size_t i = 0; i < hnd->batch_cnt; i++)
+    scbi_glue_flush_batch(hnd, &hnd->batch[i]);
+  hnd->batch_cnt = 0;
+  hnd->window_armed = 0;
+}
+
+/* add a value to its buses/devices/types batch, a value updated within the window replaces the former one */
+static void scbi_glue_collect(struct scbi_glue_handle * hnd, const char * bus, const struct scbi_param * param, uint32_t stamp)
+{
+  struct scbi_glue_batch * batch = NULL;
+  size_t i;
+
+  for (i = 0; i < hnd->batch_cnt && batch == NULL; i++)
+  {
+    if (hnd->batch[i].bus == bus && hnd->batch[i].device == param->device && hnd->batch[i].type == param->type)
+      batch = &hnd->batch[i];
+  }
+  if (batch == NULL)
+  {
+    if (hnd->batch_cnt == SCBI_GLUE_MAX_BATCHES)
+      scbi_glue_flush(hnd);
+    batch = &hnd->batch[hnd->batch_cnt++];
+    batch->bus    = bus;
+    batch->device = param->device;
+    batch->type   = param->type;
+    batch->cnt    = 0;
+  }
+  for (i = 0; i < batch->cnt && batch->item[i].name != param->name; i++)
+    ;
+  if (i == SCBI_GLUE_BATCH_ITEMS)
+  {
+    scbi_glue_flush_batch(hnd, batch);
+    i = 0;
+  }
+  if (batch->cnt == 0)
+    batch->stamp = stamp;
+  if (i == batch->cnt)
+    batch->cnt++;
+  batch->item[i].name  = param->name;
+  batch->item[i].value = param->value;
+  batch->item[i].aggregate = param->aggregate;
+
+  if (!hnd->window_armed)
+  {
+    struct itimerspec window = { { 0, 0 }, { hnd->config.window_ms / 1000, (hnd->config.window_ms % 1000) * 1000000L } };
+
+    if (timerfd_settime(hnd->window, 0, &window, NULL) < 0)
+    {
+      LG_ERROR("Arming coalescing window: Posix Error (%i) '%s'.", errno, strerror(errno));
+      scbi_glue_flush(hnd);
+      return;
+    }
+    hnd->window_armed = 1;
+  }
+}
+
+static void scbi_glue_publish(struct scbi_glue_handle * hnd)
+{
+  struct scbi_param param;
+  uint32_t          idx, stamp;
+  uint64_t          cnt;
+  int64_t           now_ms = hnd->live || hnd->store ? scbi_glue_wall_ms() : 0;
+
+  if (read(hnd->notify, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+    LG_ERROR("Reading bus notification: Posix Error (%i) '%s'.", errno, strerror(errno));
+  for (size_t i = 0; i < hnd->bus_cnt; i++)
+  {
+    struct scbi_glue_bus * bus = &hnd->bus[i];
+    const char *           via = hnd->bus_cnt > 1 ? bus->port : NULL;   /* several buses may carry the same parameters */
 
-      if ((unsigned int) rx < sizeof(struct can_frame))
+    while (scbi_glue_ring_pop(&bus->ring, &param, &idx, &stamp) == 0)
+    {
+      if (bus->view && idx < bus->param_cnt)
       {
-        scbi_print_frame (hnd->scbi, SCBI_LL_ERROR, "FRAME", "too short", &frame);
-        return;
+        bus->view[idx].updates++;
+        bus->view[idx].value     = param.value;
+        bus->view[idx].aggregate = param.aggregate;
       }
+      if (hnd->live)
+        lt_writer_put(hnd->live, i, idx, &param, now_ms);
+      if (hnd->store)
+        ts_store_put(hnd->store, i, idx, &param, now_ms);
+      if (hnd->config.window_ms == 0 || hnd->config.single)
+        scbi_glue_enqueue_value(hnd, via, &param, stamp);
+      if (hnd->config.window_ms)
+        scbi_glue_collect(hnd, via, &param, stamp);
+    }
+  }
+}
+
+#if SCBI_GLUE_LATENCY
+/* cumulative histograms since start, {"count":<n>,"max_us":<max>,"buckets":[<below 2us>,<2..3us>,<4..7us>,...]} */
+static void scbi_glue_publish_stats(struct scbi_glue_handle * hnd)
+{
+  char topic[MQTT_LINK_TOPIC_LEN];
+  char payload[SCBI_GLUE_LATENCY_BUCKETS * 11 + 64];
+
+  for (int s = 0; s < SGL_COUNT; s++)
+  {
+    struct scbi_glue_hist * hist  = s == SGL_PUBLISH ? &hnd->hist : NULL;
+    size_t                  srcs  = s == SGL_PUBLISH ? 1 : hnd->bus_cnt;
+    uint32_t                bucket[SCBI_GLUE_LATENCY_BUCKETS] = { 0 };
+    uint32_t                max = 0;
+    uint64_t                total = 0;
+    int                     used = 0, len;
+
+    for (size_t i = 0; i < srcs; i++)
+    {
+      struct scbi_glue_hist * h = hist ? hist : &hnd->bus[i].hist[s];
+      uint32_t                m = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+
+      for (int b = 0; b < SCBI_GLUE_LATENCY_BUCKETS; b++)
+        bucket[b] += atomic_load_explicit(&h->bucket[b], memory_order_relaxed);
+      if (m > max)
+        max = m;
+    }
+    for (int b = 0; b < SCBI_GLUE_LATENCY_BUCKETS; b++)
+    {
+      total += bucket[b];
+      if (bucket[b])
+        used = b + 1;
+    }
+    if (total == 0)
+      continue;
+    len = snprintf(payload, sizeof(payload), "{\"count\":%llu,\"max_us\":%u,\"buckets\":[", (unsigned long long) total, max);
+    for (int b = 0; b < used; b++)
+      len += snprintf(payload + len, sizeof(payload) - len, "%s%u", b ? "," : "", bucket[b]);
+    len += snprintf(payload + len, sizeof(payload) - len, "]}");
+    if (mqtt_link_topic(hnd->broker, topic, sizeof(topic), NULL, "$SYS", "latency", stage_translate[s]) < 0)
+      LG_ERROR("Topic for %s latency too long.", stage_translate[s]);
+    else
+      scbi_glue_enqueue(hnd, topic, payload, len, 0);
+  }
+}
+#endif
+
+/* Prometheus metrics, rendered by the publisher from state it owns: the values it took from the rings and the
+ * counters the bus threads copy about once a second - a scrape never waits for or disturbs the parsers.
+ */
+enum scbi_glue_metric
+{
+  SGM_VALUE,
+  SGM_MIN,
+  SGM_MAX,
+  SGM_MEAN,
+  SGM_RECEIVED,
+  SGM_SUPPRESSED,
+  SGM_REPOSTS,
+  SGM_PUBLISHED,
+  SGM_COUNT
+};
+
+static const struct { const char * name; const char * type; const char * help; } metric_translate[] = {
+    { "sorella_param_value",            "gauge",   "Last published value of a parameter, the windows last one if aggregated." },
+    { "sorella_param_min",              "gauge",   "Minimum of the last aggregation window." },
+    { "sorella_param_max",              "gauge",   "Maximum of the last aggregation window." },
+    { "sorella_param_mean",             "gauge",   "Mean of the last aggregation window." },
+    { "sorella_param_received_total",   "counter", "Frames carrying the parameter." },
+    { "sorella_param_suppressed_total", "counter", "Values within the deadband during the repost timeout, not published." },
+    { "sorella_param_reposts_total",    "counter", "Values within the deadband published because the repost timeout elapsed." },
+    { "sorella_param_published_total",  "counter", "Values queued for publishing." },
+};
+
+static const struct { const char * name; size_t ofs; const char * help; } counter_translate[] = {
+    { "sorella_frames_parsed_total",       offsetof(struct scbi_stats, frames_parsed),       "Frames decoded, incl. bulk transfer fragments." },
+    { "sorella_frames_rejected_total",     offsetof(struct scbi_stats, frames_rejected),     "Error, unsupported, malformed and broken bulk frames." },
+    { "sorella_frames_unregistered_total", offsetof(struct scbi_stats, frames_unregistered), "Parameter frames without a registration." },
+    { "sorella_queue_full_total",          offsetof(struct scbi_stats, queue_full),          "Parameter updates lost to an exhausted output queue." },
+};
+
+static void scbi_glue_render_param(struct exporter_page * page, enum scbi_glue_metric m, const char * port,
+                                   const struct scbi_glue_view * view, const struct scbi_param_stats * stats)
+{
+  const struct scbi_param * param = view->param;
+  int64_t                   value;
 
-      /* get the timestamp for the received message */
-      ioctl(hnd->soc, SIOCGSTAMP, &tstamp);
-      timersub(&tstamp, &hnd->start, &tstamp);
-      frame.recvd = (tstamp.tv_sec * 1000) + (tstamp.tv_usec / 1000);
+  switch (m)
+  {
+    case SGM_VALUE:      value = view->value;             break;
+    case SGM_MIN:        value = view->aggregate.min;     break;
+    case SGM_MAX:        value = view->aggregate.max;     break;
+    case SGM_MEAN:       value = view->aggregate.mean;    break;
+    case SGM_RECEIVED:   value = stats->received;         break;
+    case SGM_SUPPRESSED: value = stats->suppressed;       break;
+    case SGM_REPOSTS:    value = stats->reposts;          break;
+    default:             value = stats->published;        break;
+  }
+  exporter_printf(page, "%s{bus=\"", metric_translate[m].name);
+  exporter_label(page, port);
+  exporter_printf(page, "\",device=\"");
+  exporter_label(page, param->device);
+  exporter_printf(page, "\",type=\"%s\",name=\"", param_type_translate[param->type]);
+  exporter_label(page, param->name);
+  exporter_printf(page, "\"} %lld\n", (long long) value);
+}
+
+static void scbi_glue_render_metrics(void * ctx, struct exporter_page * page)
+{
+  struct scbi_glue_handle * hnd = ctx;
+  struct scbi_stats         bus_stats[hnd->bus_cnt];
+  int                       valid[hnd->bus_cnt];
 
-      if (scbi_parse(hnd->scbi, &frame) == 0)
+  /* the counters of all buses are copied up front, the copies are read by every metric below */
+  for (size_t i = 0; i < hnd->bus_cnt; i++)
+    valid[i] = scbi_glue_read_counters(&hnd->bus[i], &bus_stats[i]) == 0;
+  for (int m = 0; m < SGM_COUNT; m++)
+  {
+    exporter_printf(page, "# HELP %s %s\n# TYPE %s %s\n", metric_translate[m].name, metric_translate[m].help,
+                    metric_translate[m].name, metric_translate[m].type);
+    for (size_t i = 0; i < hnd->bus_cnt; i++)
+    {
+      struct scbi_glue_bus * bus = &hnd->bus[i];
+
+      for (size_t idx = 0; idx < bus->param_cnt; idx++)
       {
-        while ((param = scbi_pop_param(hnd->scbi)) != NULL)
+        if (m <= SGM_MEAN && bus->view[idx].updates == 0)
+          continue;       /* no value yet */
+        if (m >= SGM_MIN && m <= SGM_MEAN && bus->view[idx].aggregate.count == 0)
+          continue;
+        if (m >= SGM_RECEIVED && !valid[i])
+          continue;
+        scbi_glue_render_param(page, m, bus->port, &bus->view[idx], &bus->counters_copy[idx]);
+      }
+    }
+  }
+  for (size_t c = 0; c < sizeof(counter_translate) / sizeof(counter_translate[0]); c++)
+  {
+    exporter_printf(page, "# HELP %s %s\n# TYPE %s counter\n", counter_translate[c].name, counter_translate[c].help, counter_translate[c].name);
+    for (size_t i = 0; i < hnd->bus_cnt; i++)
+    {
+      if (!valid[i])
+        continue;
+      exporter_printf(page, "%s{bus=\"", counter_translate[c].name);
+      exporter_label(page, hnd->bus[i].port);
+      exporter_printf(page, "\"} %u\n", *(uint32_t *) ((char *) &bus_stats[i] + counter_translate[c].ofs));
+    }
+  }
+  exporter_printf(page, "# HELP sorella_spool_pending_bytes Bytes of messages waiting for the broker.\n# TYPE sorella_spool_pending_bytes gauge\n"
+                        "sorella_spool_pending_bytes %zu\n", spool_pending(hnd->spool));
+  exporter_printf(page, "# HELP sorella_mqtt_connected Broker connection state.\n# TYPE sorella_mqtt_connected gauge\n"
+                        "sorella_mqtt_connected %d\n", mqtt_link_connected(hnd->broker));
+}
+
+/* publisher: wait for any event source to become ready and service it - sleeps without timeout while idle */
+void scbi_glue_update (struct scbi_glue_handle * hnd)
+{
+  struct epoll_event ev[SCBI_GLUE_MAX_EVENTS];
+  uint64_t           expirations;
+  int                cnt;
+
+  cnt = epoll_wait(hnd->epfd, ev, SCBI_GLUE_MAX_EVENTS, -1);
+  if (cnt < 0)
+  {
+    if (errno != EINTR)
+      LG_ERROR("Event loop: Posix Error (%i) '%s'.", errno, strerror(errno));
+    return;
+  }
+
+  for (int i = 0; i < cnt; i++)
+  {
+    switch ((enum scbi_glue_source) ev[i].data.u32)
+    {
+      case SGS_BUS:
+        scbi_glue_publish(hnd);
+        break;
+      case SGS_MQTT:
+        if (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+          mqtt_link_read(hnd->broker);
+        if (ev[i].events & EPOLLOUT)
+          mqtt_link_write(hnd->broker);
+        break;
+      case SGS_HOUSEKEEPING:
+        if (read(hnd->housekeeping, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+          LG_ERROR("Reading housekeeping timer: Posix Error (%i) '%s'.", errno, strerror(errno));
+        mqtt_link_misc(hnd->broker);
+        spool_sync(hnd->spool);
+        if (hnd->live)
+          lt_writer_alive(hnd->live, scbi_glue_wall_ms());
+        if (hnd->metrics)
+          exporter_expire(hnd->metrics);
+        if (hnd->store && ++hnd->store_ticks * SCBI_GLUE_HOUSEKEEPING_SEC >= TS_FLUSH_SEC)
         {
-          if (param->type < SCBI_PARAM_TYPE_COUNT)
-            mqtt_publish(hnd->broker, param_type_translate[param->type], param->name, param->value);
+          hnd->store_ticks = 0;
+          ts_store_flush(hnd->store);
         }
-      }
-      fflush (stdout);
-      fflush (stderr);
+#if SCBI_GLUE_LATENCY
+        if (++hnd->stats_ticks * SCBI_GLUE_HOUSEKEEPING_SEC >= SCBI_GLUE_STATS_SEC)
+        {
+          hnd->stats_ticks = 0;
+          scbi_glue_publish_stats(hnd);
+        }
+#endif
+        break;
+      case SGS_WINDOW:
+        if (read(hnd->window, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+          LG_ERROR("Reading coalescing window timer: Posix Error (%i) '%s'.", errno, strerror(errno));
+        scbi_glue_flush(hnd);
+        break;
+      case SGS_METRICS:
+        exporter_update(hnd->metrics);
+        break;
     }
-    if (hnd->broker != NULL)
-      mqtt_loop(hnd->broker, 0);
   }
+  scbi_glue_drain(hnd);
+  scbi_glue_watch_mqtt(hnd);
+  fflush (stdout);
+  fflush (stderr);
 }
 
 void scbi_glue_destroy(struct scbi_glue_handle * hnd)
 {
   if (hnd)
   {
-    if (hnd->soc)
-      close(hnd->soc);
+    if (hnd->stop >= 0 && write(hnd->stop, &(uint64_t) { 1 }, sizeof(uint64_t)) < 0)
+      LG_ERROR("Stopping reader threads: Posix Error (%i) '%s'.", errno, strerror(errno));
+    for (size_t i = 0; i < hnd->bus_cnt; i++)
+    {
+      if (hnd->bus[i].running)
+        pthread_join(hnd->bus[i].thread, NULL);
+      if (hnd->bus[i].soc >= 0)
+        close(hnd->bus[i].soc);
+      fa_writer_close(hnd->bus[i].archive);
+      free(hnd->bus[i].view);
+      free(hnd->bus[i].counters.param);
+      free(hnd->bus[i].counters_copy);
+    }
+    if (hnd->window_armed)
+      scbi_glue_flush(hnd);
+    spool_close(hnd->spool);
+    lt_writer_close(hnd->live);
+    exporter_close(hnd->metrics);
+    ts_store_close(hnd->store);
+    if (hnd->epfd >= 0)
+      close(hnd->epfd);
+    if (hnd->housekeeping >= 0)
+      close(hnd->housekeeping);
+    if (hnd->notify >= 0)
+      close(hnd->notify);
+    if (hnd->stop >= 0)
+      close(hnd->stop);
+    if (hnd->window >= 0)
+      close(hnd->window);
     free(hnd);
   }
 }
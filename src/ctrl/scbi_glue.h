@@ -5,9 +5,26 @@
 
 #include "scbi_api.h"
 
+struct scbi_glue_config
+{
+  uint32_t window_ms;    // coalescing window, 0: publish every value on its own topic immediately
+  int      single;       // with a window: publish every value on its own topic in addition to the batches
+  const char * spool_path; // messages wait here until the broker takes them, NULL: memory only
+  size_t   spool_size;
+  const char * archive_prefix; // record all received frames to <prefix>-<port>-<time>.sfa, NULL: off
+  size_t   archive_size;       // start a new archive file at this size
+  const char * live_name;      // shm object of the live value table (see live_table.h), NULL: off
+  const char * metrics_addr;   // serve Prometheus metrics on /<path> or [<host>:]<port>, NULL: off
+  const char * ts_dir;         // keep a time series of every parameter in this directory (see ts_store.h), NULL: off
+  size_t   ts_size;            // upper limit of all its files together
+};
+
 void scbi_glue_log(enum scbi_log_level ll, const char * format, ...);
+enum scbi_log_level scbi_glue_log_level(void);
 
-struct scbi_glue_handle * scbi_glue_create(struct scbi_handle * scbi_hnd, const char *port, void * broker);
+/* serves cnt CAN interfaces port[i], each parsed by scbi_hnd[i] in its own thread */
+struct scbi_glue_handle * scbi_glue_create(struct scbi_handle ** scbi_hnd, const char ** port, size_t cnt, void * broker,
+                                           const struct scbi_glue_config * config);
 void scbi_glue_update(struct scbi_glue_handle * hnd);
 void scbi_glue_destroy(struct scbi_glue_handle * hnd);
 
@@ -0,0 +1,273 @@
+#include "ctrl/spool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ctrl/logger.h"
+
+#define SPOOL_MAGIC   0x4C4F5053  // "SPOL"
+#define SPOOL_VERSION 3
+#define SPOOL_ALIGN   4
+#define SPOOL_MAX_TOPIC   UINT16_MAX
+#define SPOOL_MAX_PAYLOAD UINT16_MAX
+
+struct spool_header      /* file layout: header, followed by the data area used as a ring from head to tail */
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;         // data area size
+  uint32_t head;         // offset of the oldest unconsumed record
+  uint32_t tail;         // offset behind the newest record
+  uint32_t used;         // bytes between head and tail, incl. the skipped end of the area - tells a full ring from an empty one
+  uint32_t dropped;      // records dropped because the spool ran full
+  uint32_t reserved[9];
+};
+
+struct spool_rec         /* record header, followed by the NUL terminated topic and the payload, padded to SPOOL_ALIGN */
+{
+  uint16_t topic_len;    // incl. NUL, 0 marks the rest of the data area as skipped
+  uint16_t payload_len;
+  uint32_t stamp;        // opaque to the spool, handed back by spool_peek
+};
+
+struct spool
+{
+  int                   fd;
+  size_t                map_len;
+  struct spool_header * hdr;
+  uint8_t *             data;
+};
+
+
+static uint32_t spool_rec_size(size_t topic_len, size_t payload_len)
+{
+  return (sizeof(struct spool_rec) + topic_len + payload_len + SPOOL_ALIGN - 1) & ~(SPOOL_ALIGN - 1);
+}
+
+static struct spool_rec * spool_rec_at(struct spool * sp, uint32_t ofs)
+{
+  return (struct spool_rec *) (sp->data + ofs);
+}
+
+/* records never wrap: the end of the area too short for the next record is skipped,
+ * marked by a record without topic unless there isn't even room for a record header */
+static int spool_is_skip(struct spool * sp, uint32_t ofs)
+{
+  return sp->hdr->size - ofs < sizeof(struct spool_rec) || spool_rec_at(sp, ofs)->topic_len == 0;
+}
+
+/* contiguous room behind the newest record */
+static uint32_t spool_room(struct spool_header * hdr)
+{
+  if (hdr->used == 0)
+    return hdr->size;
+  if (hdr->tail > hdr->head)
+    return hdr->size - hdr->tail;
+  return hdr->head - hdr->tail;
+}
+
+/* removes the oldest record, the head then continues at the front if it reached the skipped end */
+static void spool_drop_head(struct spool * sp)
+{
+  struct spool_header * hdr = sp->hdr;
+  struct spool_rec *    rec = spool_rec_at(sp, hdr->head);
+  uint32_t rec_size = spool_rec_size(rec->topic_len, rec->payload_len);
+
+  hdr->head += rec_size;
+  hdr->used -= rec_size;
+  if (hdr->used == 0)               /* drained: restart at the front, keeps the spool compact */
+    hdr->head = hdr->tail = 0;
+  else if (spool_is_skip(sp, hdr->head))
+  {
+    hdr->used -= hdr->size - hdr->head;
+    hdr->head  = 0;
+  }
+}
+
+static void spool_reset(struct spool * sp, size_t size)
+{
+  memset(sp->hdr, 0, sizeof(*sp->hdr));
+  sp->hdr->magic   = SPOOL_MAGIC;
+  sp->hdr->version = SPOOL_VERSION;
+  sp->hdr->size    = size;
+}
+
+/* a spool file surviving a crash may end in a partly written record - keep everything up to it */
+static void spool_validate(struct spool * sp, size_t size)
+{
+  struct spool_header * hdr = sp->hdr;
+  uint32_t ofs, walked;
+
+  if (hdr->magic != SPOOL_MAGIC || hdr->version != SPOOL_VERSION || hdr->size != size || hdr->used > hdr->size ||
+      hdr->head >= hdr->size || hdr->tail >= hdr->size || (hdr->head | hdr->tail) & (SPOOL_ALIGN - 1))
+  {
+    if (hdr->magic != 0)
+      LG_WARN("Spool - Discarding incompatible or damaged spool.");
+    spool_reset(sp, size);
+    return;
+  }
+  for (ofs = hdr->head, walked = 0; walked < hdr->used; )
+  {
+    struct spool_rec * rec = spool_rec_at(sp, ofs);
+    uint32_t rec_size;
+
+    if (spool_is_skip(sp, ofs))
+    {
+      if (ofs == 0 || walked + (hdr->size - ofs) > hdr->used)
+        break;
+      walked += hdr->size - ofs;
+      ofs = 0;
+      continue;
+    }
+    rec_size = spool_rec_size(rec->topic_len, rec->payload_len);
+    if (ofs + rec_size > hdr->size || walked + rec_size > hdr->used || sp->data[ofs + sizeof(*rec) + rec->topic_len - 1] != '\0')
+      break;
+    walked += rec_size;
+    ofs = ofs + rec_size == hdr->size ? 0 : ofs + rec_size;
+  }
+  if (walked != hdr->used || ofs != hdr->tail)
+  {
+    LG_WARN("Spool - Truncating damaged spool at offset %u.", ofs);
+    hdr->tail = ofs;
+    hdr->used = walked;
+  }
+  if (hdr->used == 0)
+    hdr->head = hdr->tail = 0;
+  else
+    LG_INFO("Spool - Resuming with %u bytes pending.", hdr->used);
+}
+
+struct spool * spool_open(const char * path, size_t size)
+{
+  struct spool * sp = calloc(1, sizeof(struct spool));
+
+  if (sp == NULL)
+  {
+    LG_CRITICAL("Spool - Could not allocate ressources.");
+    return NULL;
+  }
+  size &= ~(size_t) (SPOOL_ALIGN - 1);
+  if (size > UINT32_MAX)
+    size = UINT32_MAX & ~(SPOOL_ALIGN - 1);
+  sp->fd = -1;
+  sp->map_len = sizeof(struct spool_header) + size;
+
+  if (path)
+  {
+    sp->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+    if (sp->fd < 0 || ftruncate(sp->fd, sp->map_len) < 0)
+    {
+      LG_CRITICAL("Spool - Could not open spool file %s. Error: %s", path, strerror(errno));
+      spool_close(sp);
+      return NULL;
+    }
+    sp->hdr = mmap(NULL, sp->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, sp->fd, 0);
+  }
+  else
+    sp->hdr = mmap(NULL, sp->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (sp->hdr == MAP_FAILED)
+  {
+    sp->hdr = NULL;
+    LG_CRITICAL("Spool - Could not map spool. Error: %s", strerror(errno));
+    spool_close(sp);
+    return NULL;
+  }
+  sp->data = (uint8_t *) (sp->hdr + 1);
+  spool_validate(sp, size);
+  return sp;
+}
+
+/* returns 0 on success, 1 if older records had to be dropped to make room, -1 if the message doesn't fit at all */
+int spool_append(struct spool * sp, const char * topic, const void * payload, size_t len, uint32_t stamp)
+{
+  struct spool_header * hdr = sp->hdr;
+  size_t   topic_len = strlen(topic) + 1;
+  uint32_t need, dropped = 0;
+
+  if (topic_len > SPOOL_MAX_TOPIC || len > SPOOL_MAX_PAYLOAD || (need = spool_rec_size(topic_len, len)) > hdr->size)
+    return -1;
+
+  while (spool_room(hdr) < need)
+  {
+    if (hdr->tail > hdr->head)
+    {
+      /* too little left at the end: skip it and continue at the front */
+      if (hdr->size - hdr->tail >= sizeof(struct spool_rec))
+        spool_rec_at(sp, hdr->tail)->topic_len = 0;
+      hdr->used += hdr->size - hdr->tail;
+      hdr->tail  = 0;
+    }
+    else
+    {
+      /* out of room: drop the oldest record */
+      spool_drop_head(sp);
+      hdr->dropped++;
+      dropped++;
+    }
+  }
+
+  struct spool_rec * rec = spool_rec_at(sp, hdr->tail);
+  rec->topic_len   = topic_len;
+  rec->payload_len = len;
+  rec->stamp       = stamp;
+  memcpy(rec + 1, topic, topic_len);
+  memcpy((uint8_t *) (rec + 1) + topic_len, payload, len);
+  hdr->tail  = hdr->tail + need == hdr->size ? 0 : hdr->tail + need;
+  hdr->used += need;
+  return dropped ? 1 : 0;
+}
+
+/* oldest pending message, returns 0 if there is one */
+int spool_peek(struct spool * sp, const char ** topic, const void ** payload, size_t * len, uint32_t * stamp)
+{
+  struct spool_rec * rec;
+
+  if (sp->hdr->used == 0)
+    return -1;
+  rec = spool_rec_at(sp, sp->hdr->head);
+  *topic   = (const char *) (rec + 1);
+  *payload = (const uint8_t *) (rec + 1) + rec->topic_len;
+  *len     = rec->payload_len;
+  if (stamp)
+    *stamp = rec->stamp;
+  return 0;
+}
+
+void spool_consume(struct spool * sp)
+{
+  if (sp->hdr->used != 0)
+    spool_drop_head(sp);
+}
+
+size_t spool_pending(struct spool * sp)
+{
+  return sp->hdr->used;
+}
+
+void spool_sync(struct spool * sp)
+{
+  if (sp->fd >= 0 && msync(sp->hdr, sp->map_len, MS_ASYNC) < 0)
+    LG_WARN("Spool - Could not sync spool. Error: %s", strerror(errno));
+}
+
+void spool_close(struct spool * sp)
+{
+  if (sp)
+  {
+    if (sp->hdr)
+    {
+      if (sp->fd >= 0)
+        msync(sp->hdr, sp->map_len, MS_SYNC);
+      munmap(sp->hdr, sp->map_len);
+    }
+    if (sp->fd >= 0)
+      close(sp->fd);
+    free(sp);
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef _CTRL_SPOOL__H
+#define _CTRL_SPOOL__H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* bounded, append-only publish spool: a ring buffer in a memory mapped file. Messages are kept in
+ * arrival order until they are consumed, if the spool runs full the oldest ones are dropped.
+ * Without a file the spool lives in anonymous memory and doesn't survive a restart.
+ * Every message carries a caller defined stamp (eg. the time it was queued).
+ */
+
+struct spool;
+
+struct spool * spool_open(const char * path, size_t size);
+int    spool_append(struct spool * sp, const char * topic, const void * payload, size_t len, uint32_t stamp);
+int    spool_peek(struct spool * sp, const char ** topic, const void ** payload, size_t * len, uint32_t * stamp);
+void   spool_consume(struct spool * sp);
+size_t spool_pending(struct spool * sp);
+void   spool_sync(struct spool * sp);
+void   spool_close(struct spool * sp);
+
+#endif   // _CTRL_SPOOL__H
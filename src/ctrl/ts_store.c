@@ -0,0 +1,621 @@
+#define _GNU_SOURCE
+#include "ctrl/ts_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TS_REC_MAX_LEN (10 + 10)   // time and value varint
+#define TS_PATH_LEN    512
+
+struct ts_series
+{
+  int           fd;
+  uint32_t      block_cnt;
+  uint32_t      cur;           // ring position of the block in memory
+  uint64_t      seq;
+  int64_t       prev_ms;
+  int64_t       prev_delta;
+  int32_t       prev_value;
+  int           dirty;
+  uint8_t       block[TS_BLOCK_SIZE];
+};
+
+struct ts_store
+{
+  size_t             cnt;
+  size_t             resized;  // series copied to a new block count on open
+  size_t             discarded;// series started from scratch over an incompatible file
+  struct ts_series * series;
+  size_t             bus_cnt;
+  size_t             base[];   // first series of every bus, base[bus_cnt] is the series count
+};
+
+struct ts_reader
+{
+  int                           fd;
+  const uint8_t *               map;
+  size_t                        len;
+  const struct ts_file_header * hdr;
+  uint32_t                      blocks;  // blocks holding samples, in order[]
+  uint32_t                      order[]; // ring positions sorted by sequence
+};
+
+static const char * type_translate[] = { "sensor", "relay", "overview", "hcc", "controller" };
+
+
+/* helper fcts */
+
+static size_t ts_put_varint(uint8_t * p, uint64_t v)
+{
+  size_t n = 0;
+
+  while (v >= 0x80)
+  {
+    p[n++] = v | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+  return n;
+}
+
+/* 0 if the varint runs beyond end */
+static size_t ts_get_varint(const uint8_t * p, const uint8_t * end, uint64_t * v)
+{
+  size_t n = 0;
+
+  *v = 0;
+  for (; p + n < end && n < 10; n++)
+  {
+    *v |= (uint64_t) (p[n] & 0x7F) << (7 * n);
+    if ((p[n] & 0x80) == 0)
+      return n + 1;
+  }
+  return 0;
+}
+
+static inline uint64_t ts_zigzag(int64_t v)
+{
+  return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t ts_unzigzag(uint64_t v)
+{
+  return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+static void ts_copy_name(char * dst, const char * src)
+{
+  strncpy(dst, src ? src : "", TS_NAME_LEN - 1);
+  dst[TS_NAME_LEN - 1] = '\0';
+}
+
+/* <dir>/[<bus>-][<device>-]<type>-<name>.sts, path separators within names are replaced */
+static int ts_file_name(char * path, size_t size, const char * dir, const char * bus, const struct scbi_param * param)
+{
+  int len = snprintf(path, size, "%s/%s%s%s%s%s-%s" TS_FILE_EXT, dir, bus ? bus : "", bus ? "-" : "",
+                     param->device ? param->device : "", param->device ? "-" : "", type_translate[param->type], param->name);
+
+  if (len < 0 || (size_t) len >= size)
+    return -1;
+  for (char * p = path + strlen(dir) + 1; *p; p++)
+  {
+    if (*p == '/')
+      *p = '_';
+  }
+  return 0;
+}
+
+
+/* the samples of a block, stops at the first record beyond used */
+typedef int (* ts_sample_fn) (void * ctx, int64_t ms, int32_t value, int64_t delta);
+
+static int ts_decode_block(const uint8_t * block, ts_sample_fn fn, void * ctx)
+{
+  const struct ts_block_header * hdr = (const struct ts_block_header *) block;
+  const uint8_t * p   = block + sizeof(struct ts_block_header);
+  const uint8_t * end = block + (hdr->used <= TS_BLOCK_SIZE ? hdr->used : TS_BLOCK_SIZE);
+  int64_t         ms = hdr->first_ms, delta = 0;
+  int32_t         value = hdr->first_value;
+
+  if (hdr->count == 0)
+    return 0;
+  if (fn(ctx, ms, value, delta))
+    return 1;
+  for (uint32_t i = 1; i < hdr->count; i++)
+  {
+    uint64_t dod, dv;
+    size_t   n = ts_get_varint(p, end, &dod), m = n ? ts_get_varint(p + n, end, &dv) : 0;
+
+    if (m == 0)
+      return -1;
+    p += n + m;
+    delta += ts_unzigzag(dod);
+    ms    += delta;
+    value += (int32_t) ts_unzigzag(dv);
+    if (fn(ctx, ms, value, delta))
+      return 1;
+  }
+  return 0;
+}
+
+
+/* writer */
+
+static int ts_restore_sample(void * ctx, int64_t ms, int32_t value, int64_t delta)
+{
+  struct ts_series * s = ctx;
+
+  s->prev_ms    = ms;
+  s->prev_value = value;
+  s->prev_delta = delta;
+  return 0;
+}
+
+static int ts_write_block(struct ts_series * s)
+{
+  const struct ts_block_header * hdr = (const struct ts_block_header *) s->block;
+
+  s->dirty = 0;
+  if (pwrite(s->fd, s->block, hdr->used, (off_t) (1 + s->cur) * TS_BLOCK_SIZE) != hdr->used)
+    return -1;
+  return 0;
+}
+
+struct ts_block_pos
+{
+  uint64_t seq;
+  uint32_t pos;
+};
+
+static int ts_cmp_block_pos(const void * a, const void * b)
+{
+  uint64_t sa = ((const struct ts_block_pos *) a)->seq;
+  uint64_t sb = ((const struct ts_block_pos *) b)->seq;
+
+  return sa < sb ? -1 : sa > sb;
+}
+
+/* the block count changed (size limit or amount of parameters): copy the newest blocks in sequence
+ * order to a file of the new layout and replace the old one, the oldest samples are dropped if it shrinks */
+static int ts_series_resize(struct ts_series * s, const char * path, uint32_t old_cnt, const struct ts_file_header * expect)
+{
+  struct ts_block_header bhdr;
+  struct ts_block_pos *  pos;
+  char                   tmp[TS_PATH_LEN + 4];
+  uint32_t               valid = 0, keep;
+  int                    fd, rc = -1;
+
+  if ((size_t) snprintf(tmp, sizeof(tmp), "%s.new", path) >= sizeof(tmp))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  pos = malloc((old_cnt ? old_cnt : 1) * sizeof(struct ts_block_pos));
+  if (pos == NULL)
+    return -1;
+  for (uint32_t i = 0; i < old_cnt; i++)
+  {
+    if (pread(s->fd, &bhdr, sizeof(bhdr), (off_t) (1 + i) * TS_BLOCK_SIZE) == sizeof(bhdr) && bhdr.magic == TS_BLOCK_MAGIC && bhdr.count)
+    {
+      pos[valid].seq = bhdr.seq;
+      pos[valid].pos = i;
+      valid++;
+    }
+  }
+  qsort(pos, valid, sizeof(struct ts_block_pos), ts_cmp_block_pos);
+  keep = valid < expect->block_cnt ? valid : expect->block_cnt;
+
+  fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    goto ON_EXIT;
+  memset(s->block, 0, TS_BLOCK_SIZE);
+  memcpy(s->block, expect, sizeof(*expect));
+  if (ftruncate(fd, (off_t) (1 + expect->block_cnt) * TS_BLOCK_SIZE) < 0 || pwrite(fd, s->block, TS_BLOCK_SIZE, 0) != TS_BLOCK_SIZE)
+    goto ON_EXIT;
+  for (uint32_t i = 0; i < keep; i++)
+  {
+    if (pread(s->fd, s->block, TS_BLOCK_SIZE, (off_t) (1 + pos[valid - keep + i].pos) * TS_BLOCK_SIZE) != TS_BLOCK_SIZE ||
+        pwrite(fd, s->block, TS_BLOCK_SIZE, (off_t) (1 + i) * TS_BLOCK_SIZE) != TS_BLOCK_SIZE)
+      goto ON_EXIT;
+  }
+  if (fdatasync(fd) < 0 || rename(tmp, path) < 0)
+    goto ON_EXIT;
+  close(s->fd);
+  s->fd = fd;
+  fd = -1;
+  rc = 0;
+
+ON_EXIT:
+  if (fd >= 0)
+  {
+    close(fd);
+    unlink(tmp);
+  }
+  free(pos);
+  return rc;
+}
+
+/* continue an existing file of the same parameter with its newest block, otherwise start from scratch */
+static int ts_series_open(struct ts_store * ts, struct ts_series * s, const char * dir, const char * bus, const struct scbi_param * param,
+                          uint32_t block_cnt)
+{
+  struct ts_file_header  fhdr, expect = { TS_MAGIC, TS_BLOCK_SIZE, block_cnt, param->type, "", "" };
+  struct ts_block_header bhdr;
+  char                   path[TS_PATH_LEN];
+  ssize_t                len;
+  int                    match, found = 0;
+
+  ts_copy_name(expect.device, param->device);
+  ts_copy_name(expect.name, param->name);
+  s->block_cnt = block_cnt;
+  s->fd        = -1;
+  if (ts_file_name(path, sizeof(path), dir, bus, param) < 0)
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  s->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (s->fd < 0)
+    return -1;
+  len = pread(s->fd, &fhdr, sizeof(fhdr), 0);
+  if (len == sizeof(fhdr) && fhdr.block_cnt != block_cnt)
+  {
+    uint32_t old_cnt = fhdr.block_cnt;
+
+    fhdr.block_cnt = block_cnt;
+    if (memcmp(&fhdr, &expect, sizeof(fhdr)) == 0)
+    {
+      if (ts_series_resize(s, path, old_cnt, &expect) < 0)
+        return -1;
+      ts->resized++;
+    }
+    else
+      fhdr.block_cnt = old_cnt;
+  }
+  match = len == sizeof(fhdr) && memcmp(&fhdr, &expect, sizeof(fhdr)) == 0;
+  if (match)
+  {
+    for (uint32_t i = 0; i < block_cnt; i++)
+    {
+      if (pread(s->fd, &bhdr, sizeof(bhdr), (off_t) (1 + i) * TS_BLOCK_SIZE) == sizeof(bhdr) && bhdr.magic == TS_BLOCK_MAGIC &&
+          bhdr.count && (!found || bhdr.seq > s->seq))
+      {
+        s->cur = i;
+        s->seq = bhdr.seq;
+        found  = 1;
+      }
+    }
+  }
+  if (found && pread(s->fd, s->block, TS_BLOCK_SIZE, (off_t) (1 + s->cur) * TS_BLOCK_SIZE) > 0 &&
+      ts_decode_block(s->block, ts_restore_sample, s) == 0)
+    return 0;
+
+  if ((len > 0 && !match) || found)   /* another parameter type, damaged or a foreign file */
+    ts->discarded++;
+  memset(s->block, 0, TS_BLOCK_SIZE);
+  s->cur = 0;
+  s->seq = 0;
+  memcpy(s->block, &expect, sizeof(expect));
+  if (ftruncate(s->fd, 0) < 0 || ftruncate(s->fd, (off_t) (1 + block_cnt) * TS_BLOCK_SIZE) < 0 ||
+      pwrite(s->fd, s->block, TS_BLOCK_SIZE, 0) != TS_BLOCK_SIZE)
+    return -1;
+  memset(s->block, 0, TS_BLOCK_SIZE);
+  return 0;
+}
+
+struct ts_store * ts_store_open(const char * dir, size_t size, struct scbi_handle ** scbi, const char ** port, size_t cnt)
+{
+  const struct scbi_param * param;
+  struct scbi_param_stats   stats;
+  struct ts_store *         ts;
+  size_t                    params = 0, block_cnt;
+
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+    return NULL;
+  ts = calloc(1, sizeof(struct ts_store) + (cnt + 1) * sizeof(size_t));
+  if (ts == NULL)
+    return NULL;
+  for (size_t i = 0; i < cnt; i++)
+  {
+    ts->base[i] = params;
+    for (size_t idx = 0; scbi_get_param_stats(scbi[i], idx, &param, &stats) == 0; idx++)
+      params++;
+  }
+  ts->base[cnt] = params;
+  ts->bus_cnt   = cnt;
+  block_cnt = params ? size / params / TS_BLOCK_SIZE : 0;
+  block_cnt = block_cnt > TS_MIN_BLOCKS + 1 ? block_cnt - 1 : TS_MIN_BLOCKS;
+  ts->series = calloc(params ? params : 1, sizeof(struct ts_series));
+  if (ts->series == NULL)
+  {
+    free(ts);
+    return NULL;
+  }
+  for (size_t i = 0; i < cnt; i++)
+  {
+    for (size_t idx = 0; scbi_get_param_stats(scbi[i], idx, &param, &stats) == 0; idx++)
+    {
+      struct ts_series * s = &ts->series[ts->cnt++];
+
+      /* several buses may carry the same parameters, a single one keeps the file names it always had */
+      if (ts_series_open(ts, s, dir, cnt > 1 ? port[i] : NULL, param, block_cnt) < 0)
+      {
+        int err = errno;
+
+        ts_store_close(ts);
+        errno = err;
+        return NULL;
+      }
+    }
+  }
+  return ts;
+}
+
+void ts_store_get_open_stats(struct ts_store * ts, size_t * resized, size_t * discarded)
+{
+  *resized   = ts->resized;
+  *discarded = ts->discarded;
+}
+
+static void ts_series_put(struct ts_series * s, int64_t ms, int32_t value)
+{
+  struct ts_block_header * hdr = (struct ts_block_header *) s->block;
+  int64_t                  delta;
+
+  if (hdr->count && (hdr->used + TS_REC_MAX_LEN > TS_BLOCK_SIZE || hdr->count == UINT16_MAX))
+  {
+    ts_write_block(s);
+    s->cur = (s->cur + 1) % s->block_cnt;
+    s->seq++;
+    hdr->count = 0;
+  }
+  if (ms < s->prev_ms)            /* wall clock stepped back */
+    ms = s->prev_ms;
+  s->dirty = 1;
+  if (hdr->count == 0)
+  {
+    hdr->magic       = TS_BLOCK_MAGIC;
+    hdr->count       = 1;
+    hdr->used        = sizeof(struct ts_block_header);
+    hdr->seq         = s->seq;
+    hdr->first_ms    = hdr->last_ms = ms;
+    hdr->first_value = hdr->last_value = hdr->min = hdr->max = value;
+    hdr->sum         = value;
+    s->prev_ms       = ms;
+    s->prev_delta    = 0;
+    s->prev_value    = value;
+    return;
+  }
+  delta = ms - s->prev_ms;
+  hdr->used += ts_put_varint(s->block + hdr->used, ts_zigzag(delta - s->prev_delta));
+  hdr->used += ts_put_varint(s->block + hdr->used, ts_zigzag((int64_t) value - s->prev_value));
+  hdr->count++;
+  hdr->last_ms    = ms;
+  hdr->last_value = value;
+  hdr->sum       += value;
+  if (value < hdr->min)
+    hdr->min = value;
+  if (value > hdr->max)
+    hdr->max = value;
+  s->prev_ms    = ms;
+  s->prev_delta = delta;
+  s->prev_value = value;
+}
+
+void ts_store_put(struct ts_store * ts, size_t bus, int idx, const struct scbi_param * param, int64_t now_ms)
+{
+  if (bus < ts->bus_cnt && idx >= 0 && ts->base[bus] + idx < ts->base[bus + 1])   /* else registered after open */
+    ts_series_put(&ts->series[ts->base[bus] + idx], now_ms, param->value);
+}
+
+/* write the partial blocks to the page cache, left to the kernels writeback from there */
+void ts_store_flush(struct ts_store * ts)
+{
+  for (size_t i = 0; i < ts->cnt; i++)
+  {
+    if (ts->series[i].dirty)
+      ts_write_block(&ts->series[i]);
+  }
+}
+
+void ts_store_close(struct ts_store * ts)
+{
+  if (ts)
+  {
+    ts_store_flush(ts);
+    for (size_t i = 0; i < ts->cnt; i++)
+    {
+      if (ts->series[i].fd >= 0)
+        close(ts->series[i].fd);
+    }
+    free(ts->series);
+    free(ts);
+  }
+}
+
+
+/* reader */
+
+static const uint8_t * ts_reader_block(struct ts_reader * r, uint32_t pos)
+{
+  return r->map + (size_t) (1 + pos) * TS_BLOCK_SIZE;
+}
+
+static int ts_cmp_seq(const void * a, const void * b, void * ctx)
+{
+  struct ts_reader * r = ctx;
+  uint64_t sa = ((const struct ts_block_header *) ts_reader_block(r, *(const uint32_t *) a))->seq;
+  uint64_t sb = ((const struct ts_block_header *) ts_reader_block(r, *(const uint32_t *) b))->seq;
+
+  return sa < sb ? -1 : sa > sb;
+}
+
+struct ts_reader * ts_reader_open(const char * fname)
+{
+  struct ts_file_header fhdr;
+  struct ts_reader *    r;
+  struct stat           st;
+  int                   fd = open(fname, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) < 0 || pread(fd, &fhdr, sizeof(fhdr), 0) != sizeof(fhdr) || fhdr.magic != TS_MAGIC ||
+      fhdr.block_size != TS_BLOCK_SIZE || (size_t) st.st_size < (size_t) (1 + fhdr.block_cnt) * TS_BLOCK_SIZE)
+  {
+    close(fd);
+    errno = EPROTO;
+    return NULL;
+  }
+  r = calloc(1, sizeof(struct ts_reader) + fhdr.block_cnt * sizeof(uint32_t));
+  if (r == NULL)
+  {
+    close(fd);
+    return NULL;
+  }
+  r->fd  = fd;
+  r->len = (size_t) (1 + fhdr.block_cnt) * TS_BLOCK_SIZE;
+  r->map = mmap(NULL, r->len, PROT_READ, MAP_SHARED, fd, 0);
+  if (r->map == MAP_FAILED)
+  {
+    r->map = NULL;
+    ts_reader_close(r);
+    return NULL;
+  }
+  r->hdr = (const struct ts_file_header *) r->map;
+  for (uint32_t i = 0; i < fhdr.block_cnt; i++)
+  {
+    const struct ts_block_header * hdr = (const struct ts_block_header *) ts_reader_block(r, i);
+
+    if (hdr->magic == TS_BLOCK_MAGIC && hdr->count)
+      r->order[r->blocks++] = i;
+  }
+  qsort_r(r->order, r->blocks, sizeof(uint32_t), ts_cmp_seq, r);
+  return r;
+}
+
+const struct ts_file_header * ts_reader_header(struct ts_reader * r)
+{
+  return r->hdr;
+}
+
+/* time of the oldest and newest sample, -1 if the file holds none */
+int ts_reader_span(struct ts_reader * r, int64_t * first_ms, int64_t * last_ms)
+{
+  if (r->blocks == 0)
+    return -1;
+  *first_ms = ((const struct ts_block_header *) ts_reader_block(r, r->order[0]))->first_ms;
+  *last_ms  = ((const struct ts_block_header *) ts_reader_block(r, r->order[r->blocks - 1]))->last_ms;
+  return 0;
+}
+
+struct ts_range
+{
+  int64_t             from;
+  int64_t             to;
+  struct ts_aggregate agg;
+  void             (* fn) (void * ctx, int64_t ms, int32_t value);
+  void *              ctx;
+};
+
+static void ts_merge(struct ts_aggregate * agg, const struct ts_aggregate * part)
+{
+  if (part->count == 0)
+    return;
+  if (agg->count == 0)
+  {
+    *agg = *part;
+    return;
+  }
+  agg->count  += part->count;
+  agg->sum    += part->sum;
+  agg->last    = part->last;
+  agg->last_ms = part->last_ms;
+  if (part->min < agg->min)
+    agg->min = part->min;
+  if (part->max > agg->max)
+    agg->max = part->max;
+}
+
+static int ts_range_sample(void * ctx, int64_t ms, int32_t value, int64_t delta)
+{
+  struct ts_range *   range = ctx;
+  struct ts_aggregate one = { 1, value, value, value, value, ms, ms, value };
+
+  (void) delta;
+  if (ms > range->to)
+    return 1;
+  if (ms >= range->from)
+  {
+    ts_merge(&range->agg, &one);
+    if (range->fn)
+      range->fn(range->ctx, ms, value);
+  }
+  return 0;
+}
+
+/* visit the blocks overlapping the range, decoding only those not entirely within it (or all with a callback) */
+static int ts_reader_range(struct ts_reader * r, struct ts_range * range)
+{
+  struct ts_aggregate total = { 0 };
+
+  for (uint32_t i = 0; i < r->blocks; i++)
+  {
+    const uint8_t *        block = ts_reader_block(r, r->order[i]);
+    struct ts_block_header hdr;
+
+    memcpy(&hdr, block, sizeof(hdr));
+    if (hdr.magic != TS_BLOCK_MAGIC || hdr.count == 0 || hdr.last_ms < range->from || hdr.first_ms > range->to)
+      continue;
+    if (range->fn == NULL && hdr.first_ms >= range->from && hdr.last_ms <= range->to)
+    {
+      struct ts_aggregate part = { hdr.count, hdr.min, hdr.max, hdr.first_value, hdr.last_value, hdr.first_ms, hdr.last_ms, hdr.sum };
+
+      ts_merge(&total, &part);
+      continue;
+    }
+    struct ts_block_header after;
+
+    range->agg.count = 0;
+    if (ts_decode_block(block, ts_range_sample, range) < 0)
+      continue;
+    memcpy(&after, block, sizeof(after));
+    if (after.magic != hdr.magic || after.seq != hdr.seq)
+      continue;         /* overwritten meanwhile */
+    ts_merge(&total, &range->agg);
+  }
+  range->agg = total;
+  return 0;
+}
+
+int ts_reader_aggregate(struct ts_reader * r, int64_t from_ms, int64_t to_ms, struct ts_aggregate * agg)
+{
+  struct ts_range range = { .from = from_ms, .to = to_ms };
+
+  ts_reader_range(r, &range);
+  *agg = range.agg;
+  return 0;
+}
+
+int ts_reader_scan(struct ts_reader * r, int64_t from_ms, int64_t to_ms, void (* fn) (void * ctx, int64_t ms, int32_t value), void * ctx)
+{
+  struct ts_range range = { .from = from_ms, .to = to_ms, .fn = fn, .ctx = ctx };
+
+  return ts_reader_range(r, &range);
+}
+
+void ts_reader_close(struct ts_reader * r)
+{
+  if (r)
+  {
+    if (r->map)
+      munmap((void *) r->map, r->len);
+    close(r->fd);
+    free(r);
+  }
+}
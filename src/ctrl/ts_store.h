@@ -0,0 +1,90 @@
+#ifndef _CTRL_TS_STORE__H
+#define _CTRL_TS_STORE__H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ctrl/scbi_api.h"
+
+/* local time series of published parameter values, one file per parameter.
+ *
+ * A file consists of a header block followed by a fixed amount of blocks used as a ring, the block with the
+ * highest sequence number is the one being written. Every block header carries the time range and a summary
+ * (min/max/sum) of its samples, so range aggregates only decode the blocks at the ranges borders.
+ * The first sample of a block is stored in its header, the following ones as
+ *
+ *   [zigzag delta of the time delta in ms, LEB128] [zigzag delta of the value, LEB128]
+ *
+ * Samples are collected in memory and written a block at a time, at the latest every TS_FLUSH_SEC.
+ * The whole store is limited to the size given on open, the oldest samples of a parameter are overwritten first.
+ * The block count follows from size limit and amount of parameters. If either changes, an existing file is copied
+ * to the new block count (dropping its oldest blocks if it shrinks). Only a file of another parameter type or a
+ * damaged one is discarded, see ts_store_get_open_stats.
+ */
+
+#define TS_MAGIC          0x31535453  // "STS1"
+#define TS_BLOCK_MAGIC    0x4B4C4254  // "TBLK"
+#define TS_BLOCK_SIZE     4096
+#define TS_MIN_BLOCKS     4           // per parameter, regardless of the size limit
+#define TS_FLUSH_SEC      60
+#define TS_FILE_EXT       ".sts"
+#define TS_NAME_LEN       64
+
+struct ts_file_header
+{
+  uint32_t magic;
+  uint32_t block_size;
+  uint32_t block_cnt;     // ring blocks following the header block
+  uint32_t type;          // enum scbi_param_type
+  char     device[TS_NAME_LEN];
+  char     name[TS_NAME_LEN];
+};
+
+struct ts_block_header
+{
+  uint32_t magic;
+  uint16_t count;         // samples in this block
+  uint16_t used;          // bytes in use incl. this header
+  uint64_t seq;           // blocks written to the file before this one
+  int64_t  first_ms;      // wall clock (ms since epoch) of the first sample
+  int64_t  last_ms;
+  int32_t  first_value;
+  int32_t  min;
+  int32_t  max;
+  int32_t  last_value;
+  int64_t  sum;
+};
+
+struct ts_aggregate
+{
+  uint32_t count;
+  int32_t  min;
+  int32_t  max;
+  int32_t  first;
+  int32_t  last;
+  int64_t  first_ms;
+  int64_t  last_ms;
+  int64_t  sum;
+};
+
+struct ts_store;
+struct ts_reader;
+
+/* writer: <dir>/[<bus>-][<device>-]<type>-<name>.sts for all parameters registered at the given Sorella instances,
+ * one per bus (port names the interface, part of the file name only for more than one bus).
+ * A value is put by its bus and its index at that bus (scbi_get_param_index). */
+struct ts_store * ts_store_open(const char * dir, size_t size, struct scbi_handle ** scbi, const char ** port, size_t cnt);
+void ts_store_get_open_stats(struct ts_store * ts, size_t * resized, size_t * discarded);
+void ts_store_put(struct ts_store * ts, size_t bus, int idx, const struct scbi_param * param, int64_t now_ms);
+void ts_store_flush(struct ts_store * ts);
+void ts_store_close(struct ts_store * ts);
+
+/* reader: the file is mapped, samples of blocks the writer overwrites meanwhile are skipped */
+struct ts_reader * ts_reader_open(const char * fname);
+const struct ts_file_header * ts_reader_header(struct ts_reader * r);
+int  ts_reader_span(struct ts_reader * r, int64_t * first_ms, int64_t * last_ms);
+int  ts_reader_aggregate(struct ts_reader * r, int64_t from_ms, int64_t to_ms, struct ts_aggregate * agg);
+int  ts_reader_scan(struct ts_reader * r, int64_t from_ms, int64_t to_ms, void (* fn) (void * ctx, int64_t ms, int32_t value), void * ctx);
+void ts_reader_close(struct ts_reader * r);
+
+#endif   // _CTRL_TS_STORE__H
@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,12 +7,13 @@
 #include <errno.h>
 
 #include "ctrl/scbi_glue.h"
-#include "ctrl/com/mqtt.h"
+#include "ctrl/mqtt_link.h"
 #include "ctrl/logger.h"
 #include "args.h"
 #include "version.h"
 
 #define SCBI_REPOST_TIMEOUT_SEC 300 // doublette values are blocked from propagation for 5min.
+#define SCBI_PARAMS_PER_DEVICE   40 // parameter capacity reserved per device, see register_params()
 
 int do_run = TRUE;
 
@@ -21,21 +23,135 @@ void clean_exit_on_sig(int sig_num)
   do_run = FALSE;
 }
 
+static const char * hcc_field_name[SCBI_HCC_FIELD_COUNT] = {
+    "heatreq_temp", "heatreq_solar", "state", "flow_set", "flow", "storage", "wheel", "room_set", "room", "humidity",
+    "mode", "dewpoint", "pump", "on_reason", "temp_min", "temp_max"
+};
+
+static char hcc_name[CANSORELLA_MAX_HCC][SCBI_HCC_FIELD_COUNT][24];   /* hc<circuit>_<field>, registered by address */
+
+static void register_hcc(struct scbi_handle * scbi, size_t dev, struct cansorella_config * config)
+{
+  for (int i = 0; i < config->hcc_cnt; i++)
+  {
+    for (int fld = 0; fld < SCBI_HCC_FIELD_COUNT; fld++)
+    {
+      if (fld <= SCBI_HCC_HEATREQ_SOLAR)
+      {
+        if (i == 0)
+          scbi_register_hcc(scbi, dev, 0, fld, hcc_field_name[fld]);
+        continue;
+      }
+      snprintf(hcc_name[i][fld], sizeof(hcc_name[i][fld]), "hc%u_%s", config->hcc[i], hcc_field_name[fld]);
+      scbi_register_hcc(scbi, dev, config->hcc[i], fld, hcc_name[i][fld]);
+    }
+  }
+}
+
+static void register_params(struct scbi_handle * scbi, size_t dev)
+{
+  scbi_register_sensor(scbi, dev, 0, DST_UNDEFINED, "collector");
+  scbi_register_sensor(scbi, dev, 1, DST_UNDEFINED, "storage");
+  scbi_register_sensor(scbi, dev, 2, DST_UNDEFINED, "vl");
+  scbi_register_sensor(scbi, dev, 3, DST_UNDEFINED, "storage_low");
+
+  scbi_register_relay(scbi, dev, 0, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "pump_on");
+  scbi_register_relay(scbi, dev, 2, DRM_RELAYMODE_PWM     , DRE_UNSELECTED, "pump");
+  scbi_register_relay(scbi, dev, 1, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "relay1");
+
+  scbi_register_overview(scbi, dev, DOT_DAYS, DOM_00, "days0");
+  scbi_register_overview(scbi, dev, DOT_DAYS, DOM_01, "days1");
+  scbi_register_overview(scbi, dev, DOT_DAYS, DOM_02, "days2");
+  scbi_register_overview(scbi, dev, DOT_WEEKS, DOM_00, "weeks0");
+  scbi_register_overview(scbi, dev, DOT_WEEKS, DOM_01, "weeks1");
+  scbi_register_overview(scbi, dev, DOT_WEEKS, DOM_02, "weeks2");
+  scbi_register_overview(scbi, dev, DOT_MONTHS, DOM_00, "months0");
+  scbi_register_overview(scbi, dev, DOT_MONTHS, DOM_01, "months1");
+  scbi_register_overview(scbi, dev, DOT_MONTHS, DOM_02, "months2");
+  scbi_register_overview(scbi, dev, DOT_YEARS, DOM_00, "years0");
+  scbi_register_overview(scbi, dev, DOT_YEARS, DOM_01, "years1");
+  scbi_register_overview(scbi, dev, DOT_YEARS, DOM_02, "years2");
+  scbi_register_overview(scbi, dev, DOT_TOTAL, DOM_00, "total0");
+  scbi_register_overview(scbi, dev, DOT_TOTAL, DOM_01, "total1");
+  scbi_register_overview(scbi, dev, DOT_TOTAL, DOM_02, "total2");
+  scbi_register_overview(scbi, dev, DOT_STATUS, DOM_00, "status0");
+  scbi_register_overview(scbi, dev, DOT_STATUS, DOM_01, "status1");
+  scbi_register_overview(scbi, dev, DOT_STATUS, DOM_02, "status2");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN07, DOM_00, "unknown070");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN07, DOM_01, "unknown071");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN07, DOM_02, "unknown072");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN08, DOM_00, "unknown080");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN08, DOM_01, "unknown081");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN08, DOM_02, "unknown082");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN09, DOM_00, "unknown090");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN09, DOM_01, "unknown091");
+  scbi_register_overview(scbi, dev, DOT_UNKNOWN09, DOM_02, "unknown092");
+
+  scbi_register_controller(scbi, dev, SCBI_CTR_ALIVE, "alive");
+  scbi_register_controller(scbi, dev, SCBI_CTR_RESETS, "resets");
+}
+
+static void set_filters(struct scbi_handle * scbi, size_t dev, struct cansorella_config * config)
+{
+  for (int i = 0; i < config->band_cnt; i++)
+  {
+    if (scbi_set_deadband(scbi, dev, config->band[i].name, &config->band[i].band) <= 0)
+      LG_WARN("No parameter '%s' for deadband.", config->band[i].name);
+  }
+  for (int i = 0; i < config->agg_cnt; i++)
+  {
+    if (scbi_set_aggregation(scbi, dev, config->agg[i].name, config->agg[i].window_s) <= 0)
+      LG_WARN("No parameter '%s' for aggregation.", config->agg[i].name);
+  }
+  for (int i = 0; i < config->prio_cnt; i++)
+  {
+    if (scbi_set_priority(scbi, dev, config->prio[i].name, config->prio[i].prio) <= 0)
+      LG_WARN("No parameter '%s' for priority.", config->prio[i].name);
+  }
+}
+
+static struct scbi_handle * create_scbi(struct cansorella_config * config)
+{
+  struct scbi_handle * scbi = scbi_init_ex(malloc, scbi_glue_log, scbi_glue_log_level(), SCBI_REPOST_TIMEOUT_SEC,
+                                           (SCBI_PARAMS_PER_DEVICE + config->hcc_cnt * SCBI_HCC_FIELD_COUNT) * (config->dev_cnt ? config->dev_cnt : 1));
+  if (scbi == NULL)
+    return NULL;
+  for (int prio = 0; prio < SCBI_PRIO_CNT; prio++)
+    scbi_set_rate_limit(scbi, prio, config->limit[prio].rate, config->limit[prio].burst);
+  if (config->dev_cnt == 0)
+  {
+    register_params(scbi, SCBI_DEVICE_ANY);
+    register_hcc(scbi, SCBI_DEVICE_ANY, config);
+    set_filters(scbi, SCBI_DEVICE_ANY, config);
+  }
+  for (int i = 0; i < config->dev_cnt; i++)
+  {
+    int dev = scbi_register_device(scbi, config->dev[i].client, config->dev[i].name);
+    if (dev > 0)
+    {
+      register_params(scbi, dev);
+      register_hcc(scbi, dev, config);
+      set_filters(scbi, dev, config);
+    }
+  }
+  return scbi;
+}
+
 int main(int argc, char * argv[])
 {
   struct cansorella_config  config    = {0};
-  struct mqtt_handle *      mqtt      = NULL;
-  struct scbi_handle *      scbi      = NULL;
+  struct mqtt_link *        mqtt      = NULL;
+  struct scbi_handle *      scbi[CANSORELLA_MAX_CAN] = { NULL };
   struct scbi_glue_handle * scbi_glue = NULL;
-  int do_log = TRUE;
+  int scbi_cnt = 0;
 
   parseArgs(argc, argv, &config);
 
   log_init(config.prg_name, config.log_facility, config.log_level);
 
   log_push(LL_NONE, "##########################################################################");
-  log_push(LL_NONE, "Starting %s "APP_VERSION" - on:%s, LogFacility:%s Level:%s.",
-                       config.prg_name, config.can_device, log_get_facility_name(config.log_facility), log_get_level_name(config.log_level, TRUE));
+  log_push(LL_NONE, "Starting %s "APP_VERSION" - on:%s%s, LogFacility:%s Level:%s.",
+                       config.prg_name, config.can_device[0], config.can_cnt > 1 ? ",..." : "", log_get_facility_name(config.log_facility), log_get_level_name(config.log_level, TRUE));
   log_push(LL_NONE, "##########################################################################");
 
   signal(SIGABRT, clean_exit_on_sig);
@@ -44,68 +160,28 @@ int main(int argc, char * argv[])
   signal(SIGTERM, clean_exit_on_sig);
   signal(SIGPIPE, SIG_IGN);
 
-  while(do_run && mqtt_init(&mqtt, &config.mqtt) == MQTT_RET_RETRY)
-  {
-    if (do_log)
-    {
-      LG_WARN("MQTT - Could not connect to broker. Syscall returned '%s'. Retry every 5 sec.", strerror(errno));
-      do_log = FALSE;
-    }
-    sleep(5);
-  }
-
+  /* CAN reception starts right away, values are spooled until the broker is reachable */
+  mqtt = mqtt_link_create(&config.mqtt);
   if (mqtt)
   {
-    scbi = scbi_init(malloc, scbi_glue_log, SCBI_REPOST_TIMEOUT_SEC);
-    if (scbi)
+    mqtt_link_connect(mqtt);
+
+    /* one Sorella instance per bus, each one is only touched by its reader thread */
+    while (scbi_cnt < config.can_cnt && (scbi[scbi_cnt] = create_scbi(&config)) != NULL)
+      scbi_cnt++;
+    if (scbi_cnt == config.can_cnt)
     {
-      scbi_register_sensor(scbi, 0, DST_UNDEFINED, "collector");
-      scbi_register_sensor(scbi, 1, DST_UNDEFINED, "storage");
-      scbi_register_sensor(scbi, 2, DST_UNDEFINED, "vl");
-      scbi_register_sensor(scbi, 3, DST_UNDEFINED, "storage_low");
-
-      scbi_register_relay(scbi, 0, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "pump_on");
-      scbi_register_relay(scbi, 2, DRM_RELAYMODE_PWM     , DRE_UNSELECTED, "pump");
-      scbi_register_relay(scbi, 1, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "relay1");
-
-      scbi_register_overview(scbi, DOT_DAYS, DOM_00, "days0");
-      scbi_register_overview(scbi, DOT_DAYS, DOM_01, "days1");
-      scbi_register_overview(scbi, DOT_DAYS, DOM_02, "days2");
-      scbi_register_overview(scbi, DOT_WEEKS, DOM_00, "weeks0");
-      scbi_register_overview(scbi, DOT_WEEKS, DOM_01, "weeks1");
-      scbi_register_overview(scbi, DOT_WEEKS, DOM_02, "weeks2");
-      scbi_register_overview(scbi, DOT_MONTHS, DOM_00, "months0");
-      scbi_register_overview(scbi, DOT_MONTHS, DOM_01, "months1");
-      scbi_register_overview(scbi, DOT_MONTHS, DOM_02, "months2");
-      scbi_register_overview(scbi, DOT_YEARS, DOM_00, "years0");
-      scbi_register_overview(scbi, DOT_YEARS, DOM_01, "years1");
-      scbi_register_overview(scbi, DOT_YEARS, DOM_02, "years2");
-      scbi_register_overview(scbi, DOT_TOTAL, DOM_00, "total0");
-      scbi_register_overview(scbi, DOT_TOTAL, DOM_01, "total1");
-      scbi_register_overview(scbi, DOT_TOTAL, DOM_02, "total2");
-      scbi_register_overview(scbi, DOT_STATUS, DOM_00, "status0");
-      scbi_register_overview(scbi, DOT_STATUS, DOM_01, "status1");
-      scbi_register_overview(scbi, DOT_STATUS, DOM_02, "status2");
-      scbi_register_overview(scbi, DOT_UNKNOWN07, DOM_00, "unknown070");
-      scbi_register_overview(scbi, DOT_UNKNOWN07, DOM_01, "unknown071");
-      scbi_register_overview(scbi, DOT_UNKNOWN07, DOM_02, "unknown072");
-      scbi_register_overview(scbi, DOT_UNKNOWN08, DOM_00, "unknown080");
-      scbi_register_overview(scbi, DOT_UNKNOWN08, DOM_01, "unknown081");
-      scbi_register_overview(scbi, DOT_UNKNOWN08, DOM_02, "unknown082");
-      scbi_register_overview(scbi, DOT_UNKNOWN09, DOM_00, "unknown090");
-      scbi_register_overview(scbi, DOT_UNKNOWN09, DOM_01, "unknown091");
-      scbi_register_overview(scbi, DOT_UNKNOWN09, DOM_02, "unknown092");
-
-      scbi_glue = scbi_glue_create(scbi, config.can_device, mqtt);
+      scbi_glue = scbi_glue_create(scbi, config.can_device, config.can_cnt, mqtt, &config.publish);
       if (scbi_glue)
       {
         while (do_run)
           scbi_glue_update(scbi_glue);
         scbi_glue_destroy(scbi_glue);
       }
-      free(scbi);
     }
-    mqtt_close(mqtt);
+    while (scbi_cnt > 0)
+      free(scbi[--scbi_cnt]);
+    mqtt_link_destroy(mqtt);
   }
   return 0;
 }
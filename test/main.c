@@ -3,10 +3,19 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "ctrl/scbi_api.h"
+#include "ctrl/frame_archive.h"
 #include "version.h"
 
+#define REPLAY_BATCH 32
+
 void log_fn(enum scbi_log_level ll, const char * format, ...)
 {
   if (ll < SCBI_LL_CNT)
@@ -22,118 +31,416 @@ void log_fn(enum scbi_log_level ll, const char * format, ...)
 static const char * param_type_translate[] = {
     "sensor",    /* SCBI_PARAM_TYPE_SENSOR     */
     "relay",     /* SCBI_PARAM_TYPE_RELAY      */
-    "overview"   /* SCBI_PARAM_TYPE_OVERVIEW   */
+    "overview",  /* SCBI_PARAM_TYPE_OVERVIEW   */
+    "hcc",       /* SCBI_PARAM_TYPE_HCC        */
+    "controller" /* SCBI_PARAM_TYPE_CONTROLLER */
+};
+
+enum ts_mode             /* candump -t<mode> */
+{
+  TS_DELTA,              // -td: time since the previous frame
+  TS_ABS,                // -ta: wall clock
+  TS_ZERO                // -tz: time since the first frame
+};
+
+struct replay
+{
+  struct scbi_handle * hnd;
+  int                  quiet;      // neither echo input lines nor print parameters
+  double               speed;      // 0: as fast as possible, 1: real time, N: N times real time
+  enum ts_mode         ts_mode;
+  int                  started;
+  uint64_t             first_us;   // input time of the first frame, pacing refers to it
+  struct timespec      wall_start;
+  uint64_t             cum_us;     // running input time for -td dumps
+  size_t               cnt;
+  struct scbi_frame    frame[REPLAY_BATCH];
+  uint64_t             frames;
+  uint64_t             params;
+  uint64_t             skipped;
 };
 
-/* line examples:
- *   2   6              20          33  36
- *  (000.099732)  can0  10019F85   [1]  01
- *  (000.100005)  can0  00019F85   [0]
- *  (000.100254)  can0  10079F80   [8]  80 00 4D 04 00 00 00 00
- *  (000.099904)  can0  10029F80   [5]  00 00 00 FF FF
+static void replay_flush(struct replay * rp)
+{
+  struct scbi_param * param;
+
+  scbi_parse_many(rp->hnd, rp->frame, rp->cnt);
+  rp->cnt = 0;
+  while ((param = scbi_pop_param(rp->hnd)) != NULL)
+  {
+    rp->params++;
+    if (!rp->quiet)
+      printf("Name: %s,   type: %s,  value: %u.\n", param->name, param_type_translate[param->type], param->value);
+  }
+}
+
+/* feed a frame with its input time in us, sleeps to keep the requested pace */
+static void replay_frame(struct replay * rp, const struct scbi_frame * frame, uint64_t us)
+{
+  if (!rp->started)
+  {
+    rp->started  = 1;
+    rp->first_us = us;
+    clock_gettime(CLOCK_MONOTONIC, &rp->wall_start);
+  }
+  else if (rp->speed > 0 && us > rp->first_us)
+  {
+    uint64_t        ns = (uint64_t) ((us - rp->first_us) * 1000 / rp->speed);
+    struct timespec due = { rp->wall_start.tv_sec + ns / 1000000000, rp->wall_start.tv_nsec + ns % 1000000000 };
+
+    if (due.tv_nsec >= 1000000000)
+    {
+      due.tv_sec++;
+      due.tv_nsec -= 1000000000;
+    }
+    if (rp->cnt)
+      replay_flush(rp);
+    fflush(stdout);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)   /* absolute: a restart keeps the deadline */
+      ;
+  }
+  rp->frame[rp->cnt++] = *frame;
+  rp->frames++;
+  /* echoing input: keep the parameters next to the line they came from */
+  if (rp->cnt == REPLAY_BATCH || !rp->quiet)
+    replay_flush(rp);
+}
+
+static int hex_digit(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+static const char * skip_blank(const char * p, const char * end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+/* parses a candump line in [p, end), column widths don't matter. Understands
+ *
+ *   (000.099732)  can0  10019F85   [1]  01                 candump -td/-tz/-ta can0
+ *   (000.100254)  can0  10079F80   [8]  80 00 4D 04 00 00 00 00
+ *   can0  10019F85   [1]  01                               candump can0
+ *   (1436509052.249713) can0 10079F80#80004D0400000000     candump -L can0
  *
- *  command line: candump -td -d can0 > file.log
+ * returns 0 on success, *us is set if the line carries a timestamp.
  */
+static int parse_candump(const char * p, const char * end, struct scbi_frame * frame, uint64_t * us, int * has_ts)
+{
+  uint64_t sec = 0, frac = 0;
+  uint32_t id = 0;
+  int      d, digits, len = 0;
+
+  memset(frame, 0, sizeof(*frame));
+  p = skip_blank(p, end);
+  *has_ts = p < end && *p == '(';
+  if (*has_ts)
+  {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+      sec = sec * 10 + *p - '0';
+    if (p < end && *p == '.')
+    {
+      for (p++, digits = 0; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+      {
+        if (digits < 6)
+          frac = frac * 10 + *p - '0';
+      }
+      for (; digits < 6; digits++)
+        frac *= 10;
+    }
+    if (p >= end || *p++ != ')')
+      return -1;
+    *us = sec * 1000000 + frac;
+    p = skip_blank(p, end);
+  }
+  while (p < end && *p != ' ' && *p != '\t')     /* interface */
+    p++;
+  p = skip_blank(p, end);
+  for (digits = 0; p < end && (d = hex_digit(*p)) >= 0; p++, digits++)
+    id = (id << 4) | d;
+  if (digits == 0)
+    return -1;
+  frame->msg.can_id = id;
 
-#define STR2UINT32(START,END,RADIX) (end = &line[END] , strtoul(&line[START], &end, RADIX))
+  if (p < end && *p == '#')                      /* log format: data as contiguous hex digits */
+  {
+    for (p++; p + 1 < end && len < CAN_MAX_DLEN && hex_digit(p[0]) >= 0 && hex_digit(p[1]) >= 0; p += 2)
+      frame->msg.data[len++] = (hex_digit(p[0]) << 4) | hex_digit(p[1]);
+    frame->msg.len = len;
+    return 0;
+  }
 
-static void parse_line(struct scbi_frame * frame, char * line, scbi_time * cum)
+  p = skip_blank(p, end);
+  if (p >= end || *p++ != '[')
+    return -1;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    len = len * 10 + *p - '0';
+  if (p >= end || *p++ != ']' || len > CAN_MAX_DLEN)
+    return -1;
+  frame->msg.len = len;
+  for (int i = 0; i < len; i++)
+  {
+    uint32_t byte = 0;
+
+    p = skip_blank(p, end);
+    for (digits = 0; p < end && (d = hex_digit(*p)) >= 0; p++, digits++)
+      byte = (byte << 4) | d;
+    if (digits != 2)
+      return -1;
+    frame->msg.data[i] = byte;
+  }
+  return 0;
+}
+
+static const char * map_file(const char * fname, size_t * len)
 {
-  char * end;
-  uint32_t value;
-  printf("%s", line);
-  value = STR2UINT32(2,5,10);
-  *cum += value * 1000;
-  value = STR2UINT32(6,12,10);
-  *cum += value / 1000;
-
-  frame->recvd = *cum;
-  frame->msg.can_id = STR2UINT32(20,28,16);
-  frame->msg.len = STR2UINT32(33,34,16);
-
-  for (int i = 0; i < frame->msg.len; i++)
-    frame->msg.data[i] = STR2UINT32(36 + i * 3, 37 + i * 3, 16);
+  struct stat st;
+  void *      map;
+  int         fd = open(fname, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) < 0)
+  {
+    fprintf(stderr, "Could not open %s.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+  *len = st.st_size;
+  map = *len ? mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    fprintf(stderr, "Could not map %s.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+  if (map)
+    madvise(map, *len, MADV_SEQUENTIAL);
+  return map;
 }
 
-static void parse_file(struct scbi_handle * hnd, const char * fname)
+/* replay a candump text file in a single pass over its mapping */
+static void replay_candump(struct replay * rp, const char * fname)
 {
   struct scbi_frame frame;
-  struct scbi_param * param;
-  scbi_time cum = 0;
-  static FILE * fp;
-  char * line = NULL;
-  size_t len = 0;
-  ssize_t read;
-
-  fp = fopen(fname, "r");
-  if (fp == NULL)
+  size_t            len;
+  const char *      map = map_file(fname, &len);
+  const char *      end = map + len;
+  uint64_t          us = 0, first_abs = 0;
+  int               has_ts, have_abs = 0;
+
+  for (const char * line = map; line < end; )
+  {
+    const char * eol = memchr(line, '\n', end - line);
+
+    if (eol == NULL)
+      eol = end;
+    if (!rp->quiet)
+      printf("%.*s\n", (int) (eol - line), line);
+    if (parse_candump(line, eol, &frame, &us, &has_ts) == 0)
+    {
+      if (!has_ts)
+        us = rp->cum_us;
+      else if (rp->ts_mode == TS_DELTA)
+        us = rp->cum_us += us;
+      else if (rp->ts_mode == TS_ABS)
+      {
+        if (!have_abs)
+        {
+          first_abs = us;
+          have_abs  = 1;
+        }
+        us = rp->cum_us + (us - first_abs);
+      }
+      else
+        us = rp->cum_us + us;
+      frame.recvd = us / 1000;
+      replay_frame(rp, &frame, us);
+    }
+    else if (eol > line)
+      rp->skipped++;
+    line = eol + 1;
+  }
+  if (rp->ts_mode != TS_DELTA)     /* a following file continues where this one ended */
+    rp->cum_us = us;
+  if (map)
+    munmap((void *) map, len);
+}
+
+/* replay a binary frame archive recorded by cansorella -a, limited to [from, until) - wall clock ms, 0: unlimited */
+static void replay_archive(struct replay * rp, const char * fname, int64_t from, int64_t until)
+{
+  struct scbi_frame  frame;
+  struct fa_reader * rd = fa_reader_open(fname);
+  int64_t            base;
+  uint64_t           ms;
+
+  if (rd == NULL)
+  {
+    fprintf(stderr, "Could not open archive %s.\n", fname);
     exit(EXIT_FAILURE);
+  }
+  base = fa_reader_header(rd)->base_ms;
+  fa_reader_seek(rd, from > base ? from - base : 0);
+  while (fa_reader_next(rd, &frame, &ms) == 0)
+  {
+    if (until && base + (int64_t) ms >= until)
+      break;
+    replay_frame(rp, &frame, ms * 1000);
+  }
+  fa_reader_close(rd);
+}
+
+static void print_stats(struct scbi_handle * hnd)
+{
+  const struct scbi_param * param;
+  struct scbi_param_stats   pst;
+  struct scbi_stats         st;
 
-  while ((read = getline(&line, &len, fp)) != -1)
+  scbi_get_stats(hnd, &st);
+  printf("Frames parsed: %u, rejected: %u, unregistered: %u, queue full: %u.\n",
+         st.frames_parsed, st.frames_rejected, st.frames_unregistered, st.queue_full);
+  printf("%-16s %-9s %9s %10s %8s %9s\n", "parameter", "type", "received", "suppressed", "reposts", "published");
+  for (size_t i = 0; scbi_get_param_stats(hnd, i, &param, &pst) == 0; i++)
   {
-    memset(&frame, 0, sizeof frame);
-    parse_line(&frame, line, &cum);
-//    scbi_print_frame(hnd, SCBI_LL_INFO, "TEST", "TOAST", &frame);
-    if (scbi_parse(hnd,  &frame) == 0)
+    if (pst.received)
+      printf("%-16s %-9s %9u %10u %8u %9u\n", param->name, param_type_translate[param->type],
+             pst.received, pst.suppressed, pst.reposts, pst.published);
+  }
+}
+
+/* epoch seconds or local time YYYY-mm-ddTHH:MM:SS, returns ms */
+static int64_t parse_time(const char * arg)
+{
+  struct tm tm = { .tm_isdst = -1 };
+  char *    end;
+  int64_t   sec;
+
+  end = strptime(arg, "%Y-%m-%dT%H:%M:%S", &tm);
+  if (end && *end == '\0')
+    sec = mktime(&tm);
+  else
+  {
+    sec = strtoll(arg, &end, 0);
+    if (end == arg || *end != '\0')
     {
-      while ((param = scbi_pop_param(hnd)) != NULL)
-        printf("Name: %s,   type: %s,  value: %u.\n", param->name, param_type_translate[param->type], param->value);
+      fprintf(stderr, "Invalid time '%s'.\n", arg);
+      exit(EXIT_FAILURE);
     }
   }
-  fclose(fp);
+  return sec * 1000;
+}
+
+static int is_archive(const char * fname)
+{
+  size_t len = strlen(fname), ext = strlen(FA_FILE_EXT);
+  return len > ext && strcmp(fname + len - ext, FA_FILE_EXT) == 0;
 }
 
 
 int main(int argc, char * argv[])
 {
   struct scbi_handle * scbi;
+  struct replay rp = { .ts_mode = TS_DELTA };
+  struct timespec t0, t1;
+  int64_t from = 0, until = 0;
+  double elapsed;
+  char * end;
+  int opt;
 
-  const char * fname = argc > 1 ? argv[1] : "../dumps/can0.log";
+  while ((opt = getopt(argc, argv, "s:e:t:x:q")) != -1)
+  {
+    switch (opt)
+    {
+      case 's': from  = parse_time(optarg); break;
+      case 'e': until = parse_time(optarg); break;
+      case 'q': rp.quiet = 1; break;
+      case 't':
+        if (strcmp(optarg, "d") == 0)      rp.ts_mode = TS_DELTA;
+        else if (strcmp(optarg, "a") == 0) rp.ts_mode = TS_ABS;
+        else if (strcmp(optarg, "z") == 0) rp.ts_mode = TS_ZERO;
+        else goto ON_USAGE;
+        break;
+      case 'x':
+        rp.speed = strtod(optarg, &end);
+        if (end == optarg || *end != '\0' || rp.speed < 0)
+          goto ON_USAGE;
+        break;
+      default:
+      ON_USAGE:
+        fprintf(stderr, "usage: %s [-q] [-t <d|a|z>] [-x <speed>] [-s <start time>] [-e <end time>] [<candump file> | <archive" FA_FILE_EXT ">]...\n"
+                        "  -q: quiet, only print a summary.\n"
+                        "  -t: timestamps of candump files as given to candump -t: d (default) delta, a absolute, z zero based.\n"
+                        "  -x: replay speed, 1 is real time, 10 ten times faster. Default: 0 - as fast as possible.\n"
+                        "  -s, -e: epoch seconds or local time YYYY-mm-ddTHH:MM:SS, they apply to archives only.\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  const char * fname = optind < argc ? argv[optind] : "../dumps/can0.log";
 
   fprintf(stdout, "##########################################################################\n");
-  fprintf(stdout, "Starting %s " APP_VERSION " - Input file:%s.\n", argv[0], fname);
+  fprintf(stdout, "Starting %s " APP_VERSION " - Input file:%s%s.\n", argv[0], fname, argc - optind > 1 ? ",..." : "");
   fprintf(stdout, "##########################################################################\n");
 
-  scbi = scbi_init(malloc, log_fn, 300);
+  scbi = scbi_init(malloc, log_fn, rp.quiet ? SCBI_LL_ERROR : SCBI_LL_DEBUG, 300);
   if (scbi)
   {
-    scbi_register_sensor(scbi, 0, DST_UNDEFINED, "collector");
-    scbi_register_sensor(scbi, 1, DST_UNDEFINED, "storage");
-
-    scbi_register_relay(scbi, 0, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "pump_on");
-    scbi_register_relay(scbi, 2, DRM_RELAYMODE_PWM     , DRE_UNSELECTED, "pump");
-    scbi_register_relay(scbi, 1, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "relay1");
-
-    scbi_register_overview(scbi, DOT_DAYS, DOM_00, "days0");
-    scbi_register_overview(scbi, DOT_DAYS, DOM_01, "days1");
-    scbi_register_overview(scbi, DOT_DAYS, DOM_02, "days2");
-    scbi_register_overview(scbi, DOT_WEEKS, DOM_00, "weeks0");
-    scbi_register_overview(scbi, DOT_WEEKS, DOM_01, "weeks1");
-    scbi_register_overview(scbi, DOT_WEEKS, DOM_02, "weeks2");
-    scbi_register_overview(scbi, DOT_MONTHS, DOM_00, "months0");
-    scbi_register_overview(scbi, DOT_MONTHS, DOM_01, "months1");
-    scbi_register_overview(scbi, DOT_MONTHS, DOM_02, "months2");
-    scbi_register_overview(scbi, DOT_YEARS, DOM_00, "years0");
-    scbi_register_overview(scbi, DOT_YEARS, DOM_01, "years1");
-    scbi_register_overview(scbi, DOT_YEARS, DOM_02, "years2");
-    scbi_register_overview(scbi, DOT_TOTAL, DOM_00, "total0");
-    scbi_register_overview(scbi, DOT_TOTAL, DOM_01, "total1");
-    scbi_register_overview(scbi, DOT_TOTAL, DOM_02, "total2");
-    scbi_register_overview(scbi, DOT_STATUS, DOM_00, "status0");
-    scbi_register_overview(scbi, DOT_STATUS, DOM_01, "status1");
-    scbi_register_overview(scbi, DOT_STATUS, DOM_02, "status2");
-    scbi_register_overview(scbi, DOT_UNKNOWN07, DOM_00, "unknown070");
-    scbi_register_overview(scbi, DOT_UNKNOWN07, DOM_01, "unknown071");
-    scbi_register_overview(scbi, DOT_UNKNOWN07, DOM_02, "unknown072");
-    scbi_register_overview(scbi, DOT_UNKNOWN08, DOM_00, "unknown080");
-    scbi_register_overview(scbi, DOT_UNKNOWN08, DOM_01, "unknown081");
-    scbi_register_overview(scbi, DOT_UNKNOWN08, DOM_02, "unknown082");
-    scbi_register_overview(scbi, DOT_UNKNOWN09, DOM_00, "unknown090");
-    scbi_register_overview(scbi, DOT_UNKNOWN09, DOM_01, "unknown091");
-    scbi_register_overview(scbi, DOT_UNKNOWN09, DOM_02, "unknown092");
-
-    parse_file(scbi, fname);
+    rp.hnd = scbi;
+    scbi_register_sensor(scbi, SCBI_DEVICE_ANY, 0, DST_UNDEFINED, "collector");
+    scbi_register_sensor(scbi, SCBI_DEVICE_ANY, 1, DST_UNDEFINED, "storage");
+
+    scbi_register_relay(scbi, SCBI_DEVICE_ANY, 0, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "pump_on");
+    scbi_register_relay(scbi, SCBI_DEVICE_ANY, 2, DRM_RELAYMODE_PWM     , DRE_UNSELECTED, "pump");
+    scbi_register_relay(scbi, SCBI_DEVICE_ANY, 1, DRM_RELAYMODE_SWITCHED, DRE_UNSELECTED, "relay1");
+
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_DAYS, DOM_00, "days0");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_DAYS, DOM_01, "days1");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_DAYS, DOM_02, "days2");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_WEEKS, DOM_00, "weeks0");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_WEEKS, DOM_01, "weeks1");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_WEEKS, DOM_02, "weeks2");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_MONTHS, DOM_00, "months0");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_MONTHS, DOM_01, "months1");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_MONTHS, DOM_02, "months2");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_YEARS, DOM_00, "years0");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_YEARS, DOM_01, "years1");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_YEARS, DOM_02, "years2");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_TOTAL, DOM_00, "total0");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_TOTAL, DOM_01, "total1");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_TOTAL, DOM_02, "total2");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_STATUS, DOM_00, "status0");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_STATUS, DOM_01, "status1");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_STATUS, DOM_02, "status2");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN07, DOM_00, "unknown070");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN07, DOM_01, "unknown071");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN07, DOM_02, "unknown072");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN08, DOM_00, "unknown080");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN08, DOM_01, "unknown081");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN08, DOM_02, "unknown082");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN09, DOM_00, "unknown090");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN09, DOM_01, "unknown091");
+    scbi_register_overview(scbi, SCBI_DEVICE_ANY, DOT_UNKNOWN09, DOM_02, "unknown092");
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do
+    {
+      if (is_archive(fname))
+        replay_archive(&rp, fname, from, until);
+      else
+        replay_candump(&rp, fname);
+    } while (++optind < argc && (fname = argv[optind]) != NULL);
+    if (rp.cnt)
+      replay_flush(&rp);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
 
+    elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stdout, "Replayed %llu frames (%llu lines skipped), %llu parameters in %.3fs - %.0f frames/s.\n",
+            (unsigned long long) rp.frames, (unsigned long long) rp.skipped, (unsigned long long) rp.params,
+            elapsed, elapsed > 0 ? rp.frames / elapsed : 0);
+    print_stats(scbi);
   }
 	return 0;
 }
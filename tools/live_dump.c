@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ctrl/live_table.h"
+
+/* prints the live value table of a running cansorella (option -L), once or periodically.
+ *   sorella-live [-i <interval ms>] [/<live table>] [[<bus>:][<device>/]<name>]...
+ */
+
+#define LIVE_DEFAULT_NAME "/cansorella"
+
+static const char * type_name[] = { "sensor", "relay", "overview", "hcc", "controller" };
+
+static int64_t wall_ms(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void print_slot(struct lt_reader * r, int idx, int64_t now)
+{
+  const struct lt_slot * slot = lt_reader_slot(r, idx);
+  struct lt_value        val;
+
+  if (lt_reader_get(r, idx, &val) < 0)
+  {
+    printf("%-8s %-16s %-24s busy\n", slot->bus, slot->device, slot->name);
+    return;
+  }
+  printf("%-8s %-16s %-24s %-8s ", slot->bus, slot->device, slot->name, slot->type < sizeof(type_name) / sizeof(type_name[0]) ? type_name[slot->type] : "?");
+  if (val.updates == 0)
+  {
+    printf("%12s\n", "-");
+    return;
+  }
+  printf("%12d %8u %8.1fs", (int) val.value, (unsigned int) val.updates, (now - val.updated_ms) / 1000.0);
+  if (val.aggregate.count)
+    printf("  min %d max %d mean %d count %u", (int) val.aggregate.min, (int) val.aggregate.max, (int) val.aggregate.mean,
+           (unsigned int) val.aggregate.count);
+  printf("\n");
+}
+
+static int dump(struct lt_reader * r, char ** param, int cnt)
+{
+  const struct lt_header * hdr = lt_reader_header(r);
+  int64_t                  now = wall_ms();
+
+  printf("pid %u, %u parameters, alive %.1fs ago\n", (unsigned int) hdr->pid, (unsigned int) hdr->slot_cnt,
+         (now - atomic_load_explicit(&hdr->alive_ms, memory_order_relaxed)) / 1000.0);
+  printf("%-8s %-16s %-24s %-8s %12s %8s %9s\n", "bus", "device", "name", "type", "value", "updates", "age");
+  if (cnt == 0)
+  {
+    for (uint32_t i = 0; i < hdr->slot_cnt; i++)
+      print_slot(r, i, now);
+    return 0;
+  }
+  for (int i = 0; i < cnt; i++)
+  {
+    char * name = strchr(param[i], ':');
+    char * sep;
+    char   bus[LT_BUS_LEN] = "";
+    char   device[LT_DEVICE_LEN] = "";
+    int    idx;
+
+    if (name && (size_t) (name - param[i]) < sizeof(bus))
+      memcpy(bus, param[i], name - param[i]);
+    name = name ? name + 1 : param[i];
+    sep = strchr(name, '/');
+    if (sep && (size_t) (sep - name) < sizeof(device))
+      memcpy(device, name, sep - name);
+    idx = lt_reader_find(r, bus, device, sep ? sep + 1 : name);
+    if (idx < 0)
+    {
+      fprintf(stderr, "No parameter %s.\n", param[i]);
+      return -1;
+    }
+    print_slot(r, idx, now);
+  }
+  return 0;
+}
+
+int main(int argc, char * argv[])
+{
+  struct lt_reader * r;
+  const char *       name = LIVE_DEFAULT_NAME;
+  long               interval = 0;
+  int                opt;
+
+  while ((opt = getopt(argc, argv, "i:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'i':
+        interval = strtol(optarg, NULL, 0);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-i <interval ms>] [/<live table>] [[<bus>:][<device>/]<name>]...\n", argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind < argc && argv[optind][0] == '/')
+    name = argv[optind++];
+  r = lt_reader_open(name);
+  if (r == NULL)
+  {
+    fprintf(stderr, "Could not open live table %s: %s.\n", name, strerror(errno));
+    return 1;
+  }
+  while (dump(r, argv + optind, argc - optind) == 0 && interval > 0)
+  {
+    struct timespec pause = { interval / 1000, (interval % 1000) * 1000000L };
+
+    nanosleep(&pause, NULL);
+    printf("\n");
+  }
+  lt_reader_close(r);
+  return 0;
+}
@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ctrl/ts_store.h"
+
+/* range queries on the time series files of a cansorella (option -T).
+ *   sorella-ts [-f <from>] [-t <to>] [-s <step s>] [-r] <file.sts>...
+ * Times are seconds since the epoch, negative ones are relative to now, from defaults to the oldest sample.
+ * Without a step the whole range is aggregated at once, steps before the oldest or after the newest sample
+ * are left out. -r prints every sample instead.
+ */
+
+static const char * type_name[] = { "sensor", "relay", "overview", "hcc", "controller" };
+
+static int64_t wall_ms(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int parse_time(const char * arg, int64_t now, int64_t * ms)
+{
+  char * end;
+  long long sec = strtoll(arg, &end, 10);
+
+  if (end == arg || *end != '\0')
+    return -1;
+  *ms = sec < 0 ? now + sec * 1000 : sec * 1000;
+  return 0;
+}
+
+static const char * format_time(int64_t ms, char * buf, size_t size)
+{
+  time_t    sec = ms / 1000;
+  struct tm tm;
+
+  strftime(buf, size, "%Y-%m-%d %H:%M:%S", localtime_r(&sec, &tm));
+  return buf;
+}
+
+static void print_sample(void * ctx, int64_t ms, int32_t value)
+{
+  char buf[32];
+
+  (void) ctx;
+  printf("%s.%03d %12d\n", format_time(ms, buf, sizeof(buf)), (int) (ms % 1000), (int) value);
+}
+
+static void print_aggregate(int64_t from, int64_t to, const struct ts_aggregate * agg)
+{
+  char f[32], t[32];
+
+  printf("%s  %s %8u", format_time(from, f, sizeof(f)), format_time(to, t, sizeof(t)), (unsigned int) agg->count);
+  if (agg->count)
+    printf(" %10d %10d %10lld %10d %10d", (int) agg->min, (int) agg->max, (long long) (agg->sum / agg->count), (int) agg->first, (int) agg->last);
+  printf("\n");
+}
+
+static int query(const char * fname, int64_t from, int64_t to, int64_t step, int raw)
+{
+  struct ts_reader *            r = ts_reader_open(fname);
+  const struct ts_file_header * hdr;
+  int64_t                       first, last;
+
+  if (r == NULL)
+  {
+    fprintf(stderr, "Could not open time series %s: %s.\n", fname, strerror(errno));
+    return -1;
+  }
+  hdr = ts_reader_header(r);
+  if (ts_reader_span(r, &first, &last) < 0)
+    first = last = to;
+  if (from == INT64_MIN)
+    from = first;
+  printf("%s%s%s/%s\n", hdr->device, hdr->device[0] ? "/" : "", hdr->type < sizeof(type_name) / sizeof(type_name[0]) ? type_name[hdr->type] : "?", hdr->name);
+  if (raw)
+    ts_reader_scan(r, from, to, print_sample, NULL);
+  else
+  {
+    printf("%-19s  %-19s %8s %10s %10s %10s %10s %10s\n", "from", "to", "count", "min", "max", "mean", "first", "last");
+    if (step && first > from)     /* first step holding a sample */
+      from += (first - from) / step * step;
+    for (int64_t t = from; t <= to && (step == 0 || t <= last); t += step)
+    {
+      struct ts_aggregate agg;
+      int64_t             end = step && t + step - 1 < to ? t + step - 1 : to;
+
+      ts_reader_aggregate(r, t, end, &agg);
+      print_aggregate(t, end, &agg);
+      if (step == 0)
+        break;
+    }
+  }
+  ts_reader_close(r);
+  return 0;
+}
+
+int main(int argc, char * argv[])
+{
+  struct timespec begin, done;
+  int64_t         now = wall_ms(), from = INT64_MIN, to = now, step = 0;
+  int             opt, raw = 0, rc = 0;
+
+  while ((opt = getopt(argc, argv, "f:t:s:rh")) != -1)
+  {
+    switch (opt)
+    {
+      case 'f':
+      case 't':
+        if (parse_time(optarg, now, opt == 'f' ? &from : &to) < 0)
+          goto ON_USAGE;
+        break;
+      case 's':
+        step = strtoll(optarg, NULL, 10) * 1000;
+        if (step <= 0)
+          goto ON_USAGE;
+        break;
+      case 'r':
+        raw = 1;
+        break;
+      default:
+        goto ON_USAGE;
+    }
+  }
+  if (optind == argc)
+    goto ON_USAGE;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (int i = optind; i < argc; i++)
+  {
+    if (query(argv[i], from, to, step, raw) < 0)
+      rc = 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &done);
+  fprintf(stderr, "%d files queried in %.3f ms\n", argc - optind,
+          (done.tv_sec - begin.tv_sec) * 1000.0 + (done.tv_nsec - begin.tv_nsec) / 1000000.0);
+  return rc;
+
+ON_USAGE:
+  fprintf(stderr, "usage: %s [-f <from>] [-t <to>] [-s <step s>] [-r] <file.sts>...\n", argv[0]);
+  return opt == 'h' ? 0 : 1;
+}